@@ -52,6 +52,8 @@ ast_info *create_new_ast_node_info(int token, int value, int grammar_sym,
       new_token->lexeme[0] = '\0';
     }
     new_token->line_no = line_no;
+    new_token->sym = -1;
+    new_token->type = -1;
   }
   return new_token;
 }
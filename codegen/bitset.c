@@ -0,0 +1,117 @@
+// dense bitsets for dataflow analysis
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitset.h"
+
+int bitset_words(int bits) {
+    return (bits + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+}
+
+Bitset bitset_new(int words) {
+    return (Bitset) calloc(words > 0 ? words : 1, sizeof (unsigned int));
+}
+
+void bitset_free(Bitset set) {
+    free(set);
+}
+
+void bitset_set(Bitset set, int bit) {
+    set[bit / BITSET_WORD_BITS] |= 1u << (bit % BITSET_WORD_BITS);
+}
+
+void bitset_clear(Bitset set, int bit) {
+    set[bit / BITSET_WORD_BITS] &= ~(1u << (bit % BITSET_WORD_BITS));
+}
+
+int bitset_test(Bitset set, int bit) {
+    return (set[bit / BITSET_WORD_BITS] >> (bit % BITSET_WORD_BITS)) & 1;
+}
+
+void bitset_fill(Bitset set, int bits) {
+    int full = bits / BITSET_WORD_BITS;
+    int rest = bits % BITSET_WORD_BITS;
+
+    memset(set, 0xff, full * sizeof (unsigned int));
+    if (rest > 0) set[full] = (1u << rest) - 1;
+}
+
+void bitset_zero(Bitset set, int words) {
+    memset(set, 0, words * sizeof (unsigned int));
+}
+
+void bitset_copy(Bitset to, Bitset from, int words) {
+    memcpy(to, from, words * sizeof (unsigned int));
+}
+
+int bitset_union(Bitset to, Bitset from, int words) {
+    unsigned int changed = 0;
+    int i;
+
+    for (i = 0; i < words; i++) {
+        unsigned int word = to[i] | from[i];
+        changed |= word ^ to[i];
+        to[i] = word;
+    }
+    return changed != 0;
+}
+
+int bitset_intersect(Bitset to, Bitset from, int words) {
+    unsigned int changed = 0;
+    int i;
+
+    for (i = 0; i < words; i++) {
+        unsigned int word = to[i] & from[i];
+        changed |= word ^ to[i];
+        to[i] = word;
+    }
+    return changed != 0;
+}
+
+int bitset_transfer(Bitset to, Bitset gen, Bitset from, Bitset kill, int words) {
+    unsigned int changed = 0;
+    int i;
+
+    for (i = 0; i < words; i++) {
+        unsigned int word = gen[i] | (from[i] & ~kill[i]);
+        changed |= word ^ to[i];
+        to[i] = word;
+    }
+    return changed != 0;
+}
+
+int bitset_equal(Bitset a, Bitset b, int words) {
+    return memcmp(a, b, words * sizeof (unsigned int)) == 0;
+}
+
+int bitset_count(Bitset set, int words) {
+    int count = 0;
+    int i;
+
+    for (i = 0; i < words; i++) {
+        unsigned int word = set[i];
+        while (word != 0) {
+            word &= word - 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+int bitset_next(Bitset set, int start, int words) {
+    int i = start / BITSET_WORD_BITS;
+    unsigned int word;
+    int bit;
+
+    if (start < 0 || i >= words) return -1;
+    word = set[i] & (~0u << (start % BITSET_WORD_BITS));
+    for (;;) {
+        if (word != 0) {
+            for (bit = 0; !((word >> bit) & 1); bit++)
+                ;
+            return i * BITSET_WORD_BITS + bit;
+        }
+        if (++i >= words) return -1;
+        word = set[i];
+    }
+}
@@ -0,0 +1,167 @@
+// whole-program call graph, strongly connected components and
+// per-function facts (leaf, recursive, call sites)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "lexer.h"
+#include "callgraph.h"
+
+static CallNode * nodes = NULL;
+static int nodes_count = 0;
+
+static int * order = NULL;      // bottom-up order of functions
+static int order_count = 0;
+static int scc_count = 0;
+
+// state of Tarjan's algorithm
+static int * tarjan_index = NULL;
+static int * tarjan_low = NULL;
+static int * tarjan_on_stack = NULL;
+static int * tarjan_stack = NULL;
+static int tarjan_top = 0;
+static int tarjan_next = 0;
+
+static void add_callee(CallNode * node, int callee) {
+    int i;
+
+    for (i = 0; i < node->callee_count; i++)
+        if (node->callees[i] == callee) return;
+    if (node->callee_count >= node->callee_max) {
+        node->callee_max = node->callee_max > 0 ? node->callee_max * 2 : 4;
+        node->callees = (int *) realloc(node->callees, node->callee_max * sizeof (int));
+    }
+    node->callees[node->callee_count++] = callee;
+}
+
+static void collect_calls(int fun, ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int i;
+
+    if (is_call_node(node)) {
+        int callee = get_symbol(node->symbol->sym)->function;
+        nodes[fun].call_sites++;
+        nodes[callee].callers++;
+        add_callee(&nodes[fun], callee);
+    }
+    if (node->symbol->token == READ || node->symbol->token == WRITE || node->symbol->token == WRITELN)
+        nodes[fun].does_io = 1;
+    for (i = 0; i < get_num_children(node); i++)
+        collect_calls(fun, args[i]);
+}
+
+static void strong_connect(int fun) {
+    CallNode * node = &nodes[fun];
+    int i, member, first;
+
+    tarjan_index[fun] = tarjan_low[fun] = tarjan_next++;
+    tarjan_stack[tarjan_top++] = fun;
+    tarjan_on_stack[fun] = 1;
+
+    for (i = 0; i < node->callee_count; i++) {
+        int callee = node->callees[i];
+        if (tarjan_index[callee] < 0) {
+            strong_connect(callee);
+            if (tarjan_low[callee] < tarjan_low[fun]) tarjan_low[fun] = tarjan_low[callee];
+        } else if (tarjan_on_stack[callee] && tarjan_index[callee] < tarjan_low[fun]) {
+            tarjan_low[fun] = tarjan_index[callee];
+        }
+    }
+    if (tarjan_low[fun] != tarjan_index[fun]) return;
+
+    // fun is the root of a component: pop it off the stack
+    first = order_count;
+    do {
+        member = tarjan_stack[--tarjan_top];
+        tarjan_on_stack[member] = 0;
+        nodes[member].scc = scc_count;
+        order[order_count++] = member;
+    } while (member != fun);
+
+    for (i = first; i < order_count; i++) {
+        member = order[i];
+        if (order_count - first > 1) {
+            nodes[member].is_recursive = 1;
+        } else {
+            int j;
+            for (j = 0; j < nodes[member].callee_count; j++)
+                if (nodes[member].callees[j] == member) nodes[member].is_recursive = 1;
+        }
+    }
+    scc_count++;
+}
+
+void callgraph_build() {
+    int i;
+
+    callgraph_destroy();
+    nodes_count = get_function_count();
+    nodes = (CallNode *) calloc(nodes_count > 0 ? nodes_count : 1, sizeof (CallNode));
+    order = (int *) malloc((nodes_count > 0 ? nodes_count : 1) * sizeof (int));
+
+    for (i = 0; i < nodes_count; i++)
+        collect_calls(i, get_function(i)->node);
+    // main flushes the output buffer when it returns
+    for (i = 0; i < nodes_count; i++)
+        nodes[i].is_leaf = (nodes[i].call_sites == 0 && !nodes[i].does_io
+                && strcmp(get_function(i)->name, "main") != 0);
+
+    tarjan_index = (int *) malloc((nodes_count + 1) * sizeof (int));
+    tarjan_low = (int *) malloc((nodes_count + 1) * sizeof (int));
+    tarjan_on_stack = (int *) calloc(nodes_count + 1, sizeof (int));
+    tarjan_stack = (int *) malloc((nodes_count + 1) * sizeof (int));
+    for (i = 0; i < nodes_count; i++)
+        tarjan_index[i] = -1;
+    for (i = 0; i < nodes_count; i++)
+        if (tarjan_index[i] < 0) strong_connect(i);
+
+    free(tarjan_index);
+    free(tarjan_low);
+    free(tarjan_on_stack);
+    free(tarjan_stack);
+    tarjan_index = tarjan_low = tarjan_on_stack = tarjan_stack = NULL;
+    tarjan_top = tarjan_next = 0;
+}
+
+void callgraph_destroy() {
+    int i;
+
+    for (i = 0; i < nodes_count; i++)
+        free(nodes[i].callees);
+    free(nodes);
+    free(order);
+    nodes = NULL;
+    order = NULL;
+    nodes_count = order_count = scc_count = 0;
+}
+
+CallNode * get_call_node(int fun) {
+    return &nodes[fun];
+}
+
+int get_scc_count() {
+    return scc_count;
+}
+
+const int * get_bottom_up_order() {
+    return order;
+}
+
+void callgraph_dump(FILE * out) {
+    int i, j;
+
+    fprintf(out, "# call graph: %d functions, %d components\n", nodes_count, scc_count);
+    for (i = 0; i < nodes_count; i++) {
+        CallNode * node = &nodes[i];
+        fprintf(out, "%s: scc %d, %d call sites, called %d times%s%s\n",
+                get_function(i)->name, node->scc, node->call_sites, node->callers,
+                node->is_leaf ? ", leaf" : "", node->is_recursive ? ", recursive" : "");
+        for (j = 0; j < node->callee_count; j++)
+            fprintf(out, "    -> %s\n", get_function(node->callees[j])->name);
+    }
+    fprintf(out, "# bottom-up:");
+    for (i = 0; i < order_count; i++)
+        fprintf(out, " %s", get_function(order[i])->name);
+    fprintf(out, "\n");
+}
@@ -0,0 +1,249 @@
+// basic blocks, predecessors and successors of the codetable
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cfg.h"
+
+static Cfg_block * blocks = NULL;
+static int block_count = 0;
+static int block_max = 0;
+
+static Cfg_function * functions = NULL;
+static int function_count = 0;
+static int function_max = 0;
+
+static int * label_block = NULL;    // block of each label id, -1 if undefined
+static int label_block_count = 0;
+static int * instruction_block = NULL;
+
+int is_branch(Instruction_line * l) {
+    switch (l->type) {
+        case BEQZ:
+        case BNEZ:
+        case BLTZ:
+        case BGEZ:
+        case BLEZ:
+        case BGTZ:
+        case B_I:
+        case J_I:
+        case BGE:
+        case BLE:
+        case BLT:
+        case BGT:
+        case BEQ:
+        case BNE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int ends_flow(Instruction_line * l) {
+    return l->type == B_I || l->type == J_I || l->type == JR;
+}
+
+static int new_block(int first, int function) {
+    Cfg_block * block;
+
+    if (block_count >= block_max) {
+        block_max = block_max > 0 ? block_max * 2 : 64;
+        blocks = (Cfg_block *) realloc(blocks, block_max * sizeof (Cfg_block));
+    }
+    block = &blocks[block_count];
+    block->first = block->last = first;
+    block->function = function;
+    block->succ_count = 0;
+    block->preds = NULL;
+    block->pred_count = block->pred_max = 0;
+    return block_count++;
+}
+
+static int new_function(const char * name, int entry) {
+    Cfg_function * function;
+
+    if (function_count >= function_max) {
+        function_max = function_max > 0 ? function_max * 2 : 16;
+        functions = (Cfg_function *) realloc(functions, function_max * sizeof (Cfg_function));
+    }
+    function = &functions[function_count];
+    function->name = name;
+    function->entry = entry;
+    function->block_count = 0;
+    function->exit = -1;
+    return function_count++;
+}
+
+static void add_edge(int from, int to) {
+    Cfg_block * source = &blocks[from];
+    Cfg_block * target = &blocks[to];
+    int i;
+
+    for (i = 0; i < source->succ_count; i++)
+        if (source->succ[i] == to) return;
+    source->succ[source->succ_count++] = to;
+    if (target->pred_count >= target->pred_max) {
+        target->pred_max = target->pred_max > 0 ? target->pred_max * 2 : 2;
+        target->preds = (int *) realloc(target->preds, target->pred_max * sizeof (int));
+    }
+    target->preds[target->pred_count++] = from;
+}
+
+/**
+ * Splits the instructions into blocks and records the block of every label.
+ */
+static void find_blocks() {
+    int count = get_instruction_count();
+    int function = -1;
+    int current = -1;
+    int only_labels = 0;    // current block holds nothing but labels so far
+    int i;
+
+    for (i = 0; i < count; i++) {
+        Instruction_line * l = get_instruction(i);
+        int is_label = (l->type == LABEL);
+
+        if (is_label && l->label == FUNCTION) {
+            current = new_block(i, -1);
+            function = new_function(l->label_name, current);
+        } else if (current < 0 || (is_label && !only_labels)) {
+            if (function < 0) function = new_function(NULL, block_count);
+            current = new_block(i, function);
+        }
+        blocks[current].function = function;
+        blocks[current].last = i;
+        instruction_block[i] = current;
+        only_labels = (i == blocks[current].first || only_labels) && is_label;
+        if (is_label && l->label_id >= 0 && l->label_id < label_block_count)
+            label_block[l->label_id] = current;
+
+        if (is_branch(l) || ends_flow(l)) {
+            if (l->type == JR) functions[function].exit = current;
+            current = -1;
+        }
+    }
+    for (i = 0; i < block_count; i++)
+        functions[blocks[i].function].block_count++;
+}
+
+static void link_blocks() {
+    int i, target;
+
+    for (i = 0; i < block_count; i++) {
+        Instruction_line * last = get_instruction(blocks[i].last);
+        int next = i + 1;
+
+        if (!ends_flow(last) && next < block_count && blocks[next].function == blocks[i].function)
+            add_edge(i, next);
+        if (is_branch(last)) {
+            target = get_label_block(last->label_id);
+            if (target >= 0 && blocks[target].function == blocks[i].function)
+                add_edge(i, target);
+        }
+    }
+}
+
+void cfg_build() {
+    int i;
+
+    cfg_destroy();
+    label_block_count = get_label_count();
+    label_block = (int *) malloc((label_block_count + 1) * sizeof (int));
+    for (i = 0; i < label_block_count; i++)
+        label_block[i] = -1;
+    instruction_block = (int *) malloc((get_instruction_count() + 1) * sizeof (int));
+    find_blocks();
+    link_blocks();
+}
+
+void cfg_destroy() {
+    int i;
+
+    for (i = 0; i < block_count; i++)
+        free(blocks[i].preds);
+    free(blocks);
+    free(functions);
+    free(label_block);
+    free(instruction_block);
+    blocks = NULL;
+    functions = NULL;
+    label_block = NULL;
+    instruction_block = NULL;
+    block_count = block_max = 0;
+    function_count = function_max = 0;
+    label_block_count = 0;
+}
+
+int get_cfg_block_count() {
+    return block_count;
+}
+
+Cfg_block * get_cfg_block(int index) {
+    return &blocks[index];
+}
+
+int get_cfg_function_count() {
+    return function_count;
+}
+
+Cfg_function * get_cfg_function(int index) {
+    return &functions[index];
+}
+
+int get_instruction_block(int index) {
+    return instruction_block[index];
+}
+
+int get_label_block(int label_id) {
+    if (label_id < 0 || label_id >= label_block_count) return -1;
+    return label_block[label_id];
+}
+
+/**
+ * Prints the instructions of a block as a left-justified graphviz label.
+ */
+static void dump_block_text(FILE * out, FILE * scratch, Cfg_block * block) {
+    int i, c;
+
+    rewind(scratch);
+    for (i = block->first; i <= block->last; i++)
+        print_instruction(scratch, get_instruction(i));
+    fflush(scratch);
+    i = (int) ftell(scratch);
+    rewind(scratch);
+    while (i-- > 0 && (c = fgetc(scratch)) != EOF) {
+        if (c == '\n')
+            fprintf(out, "\\l");
+        else if (c == '\t')
+            fputc(' ', out);
+        else if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else
+            fputc(c, out);
+    }
+}
+
+void cfg_dump(FILE * out) {
+    FILE * scratch = tmpfile();
+    int i, j, k;
+
+    fprintf(out, "digraph cfg {\n");
+    fprintf(out, "    node [shape=box, fontname=\"monospace\"];\n");
+    for (i = 0; i < function_count; i++) {
+        Cfg_function * function = &functions[i];
+        fprintf(out, "    subgraph cluster_%d {\n", i);
+        fprintf(out, "        label=\"%s\";\n", function->name ? function->name : "(no function)");
+        for (j = function->entry; j < function->entry + function->block_count; j++) {
+            fprintf(out, "        B%d [label=\"B%d%s%s\\l", j, j,
+                    j == function->entry ? " (entry)" : "", j == function->exit ? " (exit)" : "");
+            if (scratch != NULL) dump_block_text(out, scratch, &blocks[j]);
+            fprintf(out, "\"];\n");
+        }
+        for (j = function->entry; j < function->entry + function->block_count; j++) {
+            for (k = 0; k < blocks[j].succ_count; k++)
+                fprintf(out, "        B%d -> B%d;\n", j, blocks[j].succ[k]);
+        }
+        fprintf(out, "    }\n");
+    }
+    fprintf(out, "}\n");
+    if (scratch != NULL) fclose(scratch);
+}
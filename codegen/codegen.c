@@ -3,34 +3,37 @@
 
 // TODO: add more includes files here as necessary
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include "parser.h"
 #include "codegen.h"
 #include "codetable.h"
+#include "semantic.h"
+#include "callgraph.h"
 #include "lexer.h"
+#include "strength.h"
 
-// constants for "and" and "or" labels
-int and_label = -1;
-int or_label = -1;
+// availability of $t0-$t7, 1 if free
+int registers[REGISTER_COUNT];
 
-// function declarations
-VarAddress lookup_variable(const char * name);
-VarAddress lookup_array(const char * name);
-FunDef lookup_function(const char* name);
+// frame of the function being emitted, see handle_fun_decl; its slots
+// are addressed from $fp, which stands for $sp at entry, until
+// rebase_frame() knows the frame size
+int function_entry_height = 0; // stack height at the entry of the current function
+int max_stack_height = 0;       // highest stack height reached in the current function
+int max_outgoing_size = 0;      // largest outgoing area of a call in the current function
+
+// names are resolved by semantic analysis before codegen runs; every
+// ID node carries the index of its Symbol in symbol->sym
 
 // this function will be called after your parse function
-// depending on how you are storing the AST (a global or a return
-// value from parse, you may need to add some parameters to this function
-void codegen(FILE * out, ast_node * root) {
+// it fills the codetable; the caller writes and destroys it
+void codegen(ast_node * root) {
   codetable_init();
+  init_symbol_heights();
   init_registers();
   handle_program(root);
-  if (codetable_print(out) == 0) {
-    printf("Success\n");
-  } else {
-    printf("Error writing instructions\n");
-  }
-  codetable_destroy();
+  destroy_symbol_heights();
 }
 
 void free_register(int reg) {
@@ -132,19 +135,288 @@ int handle_return(ast_node * node) {
 }
 
 int handle_num(ast_node * node) {
-    int dest_reg = allocate_register();
+    int dest_reg;
+
+    if (node->symbol->value == 0) return ZERO;
+    dest_reg = allocate_register();
     add_instruction(create_instruction(LI, dest_reg, node->symbol->value, 0));
 
     return dest_reg;
 }
 
+/**
+ * Evaluates an operand that the operation is computed into, which must be
+ * a register of its own: a literal 0 evaluates to $zero.
+ * @return: the register holding the value
+ */
+static int handle_left(ast_node * node) {
+    int reg = get_handle_function(node)(node);
+
+    if (reg == ZERO) {
+        reg = allocate_register();
+        add_instruction(create_instruction(LI, reg, 0, 0));
+    }
+    return reg;
+}
+
+/**
+ * @return: the comparison that holds when the operands are swapped
+ */
+static int mirrored(int token) {
+    switch (token) {
+        case LSS: return GTR;
+        case GTR: return LSS;
+        case LEQ: return GEQ;
+        case GEQ: return LEQ;
+    }
+    return token;
+}
+
+/**
+ * Emits an operation with a literal operand c that fits an immediate the
+ * way lower_immediate() in irgen.c does: addi for x + c and x - c, slti
+ * for x < c and x <= c (x < c + 1), the negation of one of those for
+ * x > c and x >= c, and x ^ c tested against 0 for x == c and x != c,
+ * with c from 0 to 65535 since xori takes an unsigned immediate.
+ * @return: the register holding the value, -1 if the expression has no
+ *          such form
+ */
+static int handle_immediate(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int token = node->symbol->token;
+    ast_node * x = args[0];
+    long long c;
+    int reg;
+
+    if (get_num_children(node) != 2) return -1;
+    if (args[1]->symbol->token == NUM) {
+        c = args[1]->symbol->value;
+    } else if (args[0]->symbol->token == NUM && token != PLUS && token != MINUS) {
+        x = args[1];
+        c = args[0]->symbol->value;
+        token = mirrored(token);
+    } else {
+        return -1;
+    }
+    if (token == MINUS) c = -c;
+    if (token == LEQ || token == GTR) c++;
+    if (token == EQU || token == NEQ) {
+        if (c < 0 || c > LOGICAL_IMMEDIATE_MAX) return -1;
+    } else if (!is_immediate(c)) {
+        return -1;
+    }
+    reg = handle_left(x);
+    switch (token) {
+        case PLUS:
+        case MINUS:
+            add_instruction(create_instruction(ADDI, reg, reg, (int) c));
+            break;
+        case LSS:
+        case LEQ:
+            add_instruction(create_instruction(SLTI, reg, reg, (int) c));
+            break;
+        case GTR:
+        case GEQ:
+            add_instruction(create_instruction(SLTI, reg, reg, (int) c));
+            add_instruction(create_instruction(XORI, reg, reg, 1));
+            break;
+        case EQU:
+        case NEQ:
+            // unlike x + -c, x ^ c cannot overflow
+            if (c != 0) add_instruction(create_instruction(XORI, reg, reg, (int) c));
+            if (token == EQU)
+                add_instruction(create_instruction(SLTIU, reg, reg, 1));
+            else
+                add_instruction(create_instruction(SLTU, reg, ZERO, reg));
+            break;
+    }
+    return reg;
+}
+
+static int is_comparison(int token) {
+    return token == LSS || token == LEQ || token == GTR || token == GEQ
+        || token == EQU || token == NEQ;
+}
+
+/**
+ * @return: the comparison that holds when token does not
+ */
+static int negated(int token) {
+    switch (token) {
+        case LSS: return GEQ;
+        case GEQ: return LSS;
+        case LEQ: return GTR;
+        case GTR: return LEQ;
+        case EQU: return NEQ;
+        case NEQ: return EQU;
+    }
+    return token;
+}
+
+/**
+ * @return: the branch taken when its first register compares to the
+ *          second as token says, or to 0 when zero is set
+ */
+static Instruction_type compare_branch(int token, int zero) {
+    switch (token) {
+        case LSS: return zero ? BLTZ : BLT;
+        case LEQ: return zero ? BLEZ : BLE;
+        case GTR: return zero ? BGTZ : BGT;
+        case GEQ: return zero ? BGEZ : BGE;
+        case EQU: return zero ? BEQZ : BEQ;
+    }
+    return zero ? BNEZ : BNE;
+}
+
+/**
+ * Emits a condition as a branch to label sn taken when its value is when,
+ * 0 or 1, without computing the value, the way lower_cond() in irgen.c
+ * does: ! flips when, a comparison branches on its operands, against
+ * $zero for the literal 0, and x < c with any other literal c that fits
+ * an immediate is slti and a test of the result.  a && b and a || b
+ * short-circuit: when a decides the value it branches to label sn if
+ * that is the value wanted, else past the branches of b.
+ */
+static void branch_on(ast_node * node, int when, Label_type label, int sn) {
+    ast_node ** args = get_childlist(node);
+    int token = node->symbol->token;
+    ast_node * x, * y;
+    long long c;
+    int reg, arg1_reg, decides, skip_sn;
+
+    switch (token) {
+        case NUM:
+            if ((node->symbol->value != 0) == when)
+                add_instruction(create_jump_instruction(J_I, 0, 0, label, sn));
+            return;
+        case NEG:
+            branch_on(args[0], !when, label, sn);
+            return;
+        case AND:
+        case OR:
+            // a decides a && b when it is 0, a || b when it is not
+            decides = (token == OR);
+            if (decides == when) {
+                branch_on(args[0], decides, label, sn);
+                branch_on(args[1], when, label, sn);
+            } else {
+                skip_sn = get_next_label_sn(LABEL_COMPARE_END);
+                branch_on(args[0], decides, LABEL_COMPARE_END, skip_sn);
+                branch_on(args[1], when, label, sn);
+                add_instruction(create_instruction_label(LABEL_COMPARE_END, skip_sn));
+            }
+            return;
+    }
+    if (!is_comparison(token)) {
+        reg = get_handle_function(node)(node);
+        add_instruction(create_jump_instruction(when ? BNEZ : BEQZ, reg, 0, label, sn));
+        free_register(reg);
+        return;
+    }
+    x = args[0];
+    y = args[1];
+    if (x->symbol->token == NUM) {
+        x = args[1];
+        y = args[0];
+        token = mirrored(token);
+    }
+    if (y->symbol->token == NUM && y->symbol->value != 0 && token != EQU && token != NEQ) {
+        c = y->symbol->value;
+        if (token == LEQ || token == GTR) c++;
+        if (is_immediate(c)) {
+            // x < c + 1 for <= and >, x < c for < and >=
+            reg = handle_left(x);
+            add_instruction(create_instruction(SLTI, reg, reg, (int) c));
+            if ((token == LSS || token == LEQ) == when)
+                add_instruction(create_jump_instruction(BNEZ, reg, 0, label, sn));
+            else
+                add_instruction(create_jump_instruction(BEQZ, reg, 0, label, sn));
+            free_register(reg);
+            return;
+        }
+    }
+    if (!when) token = negated(token);
+    if (x->num_children == 0) {
+        arg1_reg = get_handle_function(y)(y);
+        reg = get_handle_function(x)(x);
+    } else {
+        reg = get_handle_function(x)(x);
+        arg1_reg = get_handle_function(y)(y);
+    }
+    if (reg == ZERO) {
+        reg = arg1_reg;
+        arg1_reg = ZERO;
+        token = mirrored(token);
+    }
+    if (arg1_reg == ZERO)
+        add_instruction(create_jump_instruction(compare_branch(token, 1), reg, 0, label, sn));
+    else
+        add_instruction(create_jump_instruction(compare_branch(token, 0), reg, arg1_reg, label, sn));
+    free_register(reg);
+    free_register(arg1_reg);
+}
+
+/**
+ * Emits a load into reg, or a store of reg, of a scalar variable: a global
+ * is small data, one instruction from $gp, the rest are frame slots.
+ */
+static void access_variable(Instruction_type type, int reg, VarAddress var) {
+	if (var.label != NULL)
+		add_instruction(create_instruction_data(type, reg, var.label, 0));
+	else
+		add_instruction(create_instruction_offset(type, reg, fp, 0, var.offset));
+}
+
+/**
+ * Puts the address of element 0 of an array in reg; an array parameter
+ * holds the address its caller passed.
+ */
+static void load_array_base(VarAddress var, int reg) {
+	if (var.label != NULL)
+		add_instruction(create_jump_label_instruction(LA, reg, 0, var.label));
+	else if (var.indirect)
+		add_instruction(create_instruction_offset(LW, reg, fp, 0, var.offset));
+	else
+		add_instruction(create_instruction(ADDI, reg, fp, var.offset));
+}
+
 void compute_index(VarAddress var, int index_reg) {
 	int var_size_reg = allocate_register();
-	add_instruction(create_instruction(LI, var_size_reg, var.size, 0));
-	add_instruction(create_instruction(MUL, index_reg, index_reg, var_size_reg));
+	if (var.size == 4)
+		add_instruction(create_instruction(SLL, index_reg, index_reg, 2));
+	load_array_base(var, var_size_reg);
+	add_instruction(create_instruction(ADD, index_reg, var_size_reg, index_reg));
 	free_register(var_size_reg);
-	add_instruction(create_instruction(SUB, index_reg, sp, index_reg));
-	add_instruction(create_instruction(ADDI, index_reg, index_reg, var.offset));
+}
+
+/**
+ * @return: 1 if the index is a literal whose element offset fits the
+ *          offset of a load or store
+ */
+static int is_constant_index(ast_node * index, VarAddress var) {
+	return index->symbol->token == NUM && is_immediate((long long) index->symbol->value * var.size);
+}
+
+/**
+ * Emits a load into reg, or a store of reg, of the array element at a
+ * constant index: the offset of the element is added to the offset of a
+ * frame array or the label of small data, or to the array base in a
+ * scratch register.
+ */
+static void access_element(Instruction_type type, int reg, VarAddress var, int index) {
+	int offset = index * var.size;
+	int base_reg;
+
+	if (var.label == NULL && !var.indirect) {
+		add_instruction(create_instruction_offset(type, reg, fp, 0, var.offset + offset));
+	} else if (var.label != NULL && codetable_is_small_data(var.label)) {
+		add_instruction(create_instruction_data(type, reg, var.label, offset));
+	} else {
+		base_reg = allocate_register();
+		load_array_base(var, base_reg);
+		add_instruction(create_instruction_offset(type, reg, base_reg, 0, offset));
+		free_register(base_reg);
+	}
 }
 
 int handle_id(ast_node * node) {
@@ -157,26 +429,21 @@ int handle_id(ast_node * node) {
 
     info = node->symbol;
     if (num_args == 0) {
-    	var = lookup_variable(info->lexeme);
-        if (var.offset < 0) {
-            handle_error("error: variable undeclared (first use in this function)", info->line_no);
-        }
-        if (var.size == 1)
-            add_instruction(create_instruction_offset(LB, dest_reg, sp, 0, var.offset));
-        else
-            add_instruction(create_instruction_offset(LW, dest_reg, sp, 0, var.offset));
+    	var = symbol_address(info->sym);
+        access_variable(var.size == 1 ? LB : LW, dest_reg, var);
     } else {
         if (args[0]->symbol->grammar_symbol == EXPR_LIST) {
-            call_function(node);
+            call_function(node, dest_reg);
             add_instruction(create_instruction(MOVE, dest_reg, v0, 0));
         }
         else {
-    		var = lookup_array(info->lexeme);
-		    if (var.offset < 0) {
-		        handle_error("error: array undeclared (first use in this function)", info->line_no);
-		    }
+    		var = symbol_address(info->sym);
+    		if (is_constant_index(args[0], var)) {
+    			access_element(var.size == 1 ? LB : LW, dest_reg, var, args[0]->symbol->value);
+    			return dest_reg;
+    		}
 
-        	int index_reg = get_handle_function(args[0])(args[0]);
+        	int index_reg = handle_left(args[0]);
         	compute_index(var, index_reg);
         	if (var.size == 1)
 		        add_instruction(create_instruction_offset(LB, dest_reg, index_reg, 0, 0)); // load array element address
@@ -193,19 +460,19 @@ int handle_while(ast_node * node) {
     printf("Handle WHILE\n");
 
     ast_node ** args = get_childlist(node);
-    int while_cond_reg;
     int while_label_sn = get_next_label_sn(LABEL_WHILE);
     int while_end_label_sn = get_next_label_sn(LABEL_WHILE_END);
     int reg = 0;
 
     // create while condition label
     add_instruction(create_instruction_label(LABEL_WHILE, while_label_sn));
-    // jump based on the condition
-    while_cond_reg = get_handle_function(args[0])(args[0]);
-    add_instruction(create_jump_instruction(BEQZ, while_cond_reg, 0, LABEL_WHILE_END, while_end_label_sn));
-    // while body
-    reg = get_handle_function(args[1])(args[1]);
-    if (reg != 0) free_register(reg);
+    // leave the loop unless the condition holds, never for a constant that does
+    branch_on(args[0], 0, LABEL_WHILE_END, while_end_label_sn);
+    // while body, left out by the parser when it could not parse one
+    if (get_num_children(node) > 1) {
+        reg = get_handle_function(args[1])(args[1]);
+        if (reg != 0) free_register(reg);
+    }
     // jump to while condition
     add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_WHILE, while_label_sn));
     // add while_end label
@@ -224,19 +491,18 @@ int handle_if(ast_node * node) {
     printf("Handle IF\n");
 
     ast_node ** args = get_childlist(node);
-    int if_reg;
+    int num_args = get_num_children(node);
     int else_label_sn = get_next_label_sn(LABEL_ELSE);
     int if_else_end_sn = get_next_label_sn(LABEL_IF_ELSE_END);
 
-    if_reg = get_handle_function(args[0])(args[0]);
-    // jump to else label based on the condition
-    add_instruction(create_jump_instruction(BEQZ, if_reg, 0, LABEL_ELSE, else_label_sn));
-    // if body
-    get_handle_function(args[1])(args[1]);
+    // jump to else label unless the condition holds
+    branch_on(args[0], 0, LABEL_ELSE, else_label_sn);
+    // if body, left out by the parser when it could not parse one
+    if (num_args == 3) get_handle_function(args[1])(args[1]);
     // jump to if else end
     add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_IF_ELSE_END, if_else_end_sn));
     // handle else body
-    handle_else(args[2], else_label_sn);
+    handle_else(args[num_args - 1], else_label_sn);
     // add if else end label
     add_instruction(create_instruction_label(LABEL_IF_ELSE_END, if_else_end_sn));
     return 0;
@@ -247,38 +513,31 @@ int handle_else(ast_node * node, int label_sn) {
     ast_node ** args = get_childlist(node);
     // add else label
     add_instruction(create_instruction_label(LABEL_ELSE, label_sn));
-    get_handle_function(args[0])(args[0]);
+    if (get_num_children(node) > 0) get_handle_function(args[0])(args[0]);
 
     return 0;
 }
 
 int handle_geq(ast_node * node) {
     printf("Handle GEQ\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
     int arg1_reg;
-    int compare_sn = get_next_label_sn(LABEL_COMPARE);
-    int compare_end_sn = get_next_label_sn(LABEL_COMPARE_END);
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
-
-    add_instruction(create_jump_instruction(BGE, arg0_reg, arg1_reg, LABEL_COMPARE, compare_sn));
-
-    add_instruction(create_instruction(XOR, arg0_reg, arg0_reg, arg0_reg));
-    add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_COMPARE_END, compare_end_sn));
-
-    add_instruction(create_instruction_label(LABEL_COMPARE, compare_sn));
-    add_instruction(create_instruction(LI, arg0_reg, 1, 0));
-    add_instruction(create_instruction_label(LABEL_COMPARE_END, compare_end_sn));
-
+    // a >= b is !(a < b)
+    add_instruction(create_instruction(SLT, arg0_reg, arg0_reg, arg1_reg));
+    add_instruction(create_instruction(XORI, arg0_reg, arg0_reg, 1));
     free_register(arg1_reg);
 
     return arg0_reg;
@@ -286,6 +545,8 @@ int handle_geq(ast_node * node) {
 
 int handle_gtr(ast_node * node) {
     printf("Handle GTR\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
@@ -294,9 +555,9 @@ int handle_gtr(ast_node * node) {
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
@@ -308,31 +569,24 @@ int handle_gtr(ast_node * node) {
 
 int handle_leq(ast_node * node) {
     printf("Handle LEQ\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
     int arg1_reg;
-    int compare_sn = get_next_label_sn(LABEL_COMPARE);
-    int compare_end_sn = get_next_label_sn(LABEL_COMPARE_END);
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
-
-    add_instruction(create_jump_instruction(BLE, arg0_reg, arg1_reg, LABEL_COMPARE, compare_sn));
-
-    add_instruction(create_instruction(XOR, arg0_reg, arg0_reg, arg0_reg));
-    add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_COMPARE_END, compare_end_sn));
-
-    add_instruction(create_instruction_label(LABEL_COMPARE, compare_sn));
-    add_instruction(create_instruction(LI, arg0_reg, 1, 0));
-    add_instruction(create_instruction_label(LABEL_COMPARE_END, compare_end_sn));
-
+    // a <= b is !(b < a)
+    add_instruction(create_instruction(SLT, arg0_reg, arg1_reg, arg0_reg));
+    add_instruction(create_instruction(XORI, arg0_reg, arg0_reg, 1));
     free_register(arg1_reg);
 
     return arg0_reg;
@@ -340,6 +594,8 @@ int handle_leq(ast_node * node) {
 
 int handle_lss(ast_node * node) {
     printf("Handle LSS\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
@@ -347,9 +603,9 @@ int handle_lss(ast_node * node) {
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
@@ -361,6 +617,8 @@ int handle_lss(ast_node * node) {
 
 int handle_neq(ast_node * node) {
     printf("Handle NEQ\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
@@ -368,13 +626,15 @@ int handle_neq(ast_node * node) {
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
+    // a ^ b is not 0 exactly when they differ
     add_instruction(create_instruction(XOR, arg0_reg, arg0_reg, arg1_reg));
+    add_instruction(create_instruction(SLTU, arg0_reg, ZERO, arg0_reg));
     free_register(arg1_reg);
 
     return arg0_reg;
@@ -382,33 +642,27 @@ int handle_neq(ast_node * node) {
 
 int handle_equ(ast_node * node) {
     printf("Handle EQU\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
     int arg1_reg;
-    int zero_register;
-    int one_register;
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
+    // a ^ b is 0 exactly when they are equal
     add_instruction(create_instruction(XOR, arg0_reg, arg0_reg, arg1_reg));
-    // negate the logical value
-    zero_register = allocate_register();
-    one_register = allocate_register();
-    add_instruction(create_instruction(AND_I, zero_register, zero_register, ZERO));
-    add_instruction(create_instruction(LI, one_register, 1, 0));
-    add_instruction(create_instruction(MOVZ, zero_register, one_register, arg0_reg));
-    free_register(one_register);
+    add_instruction(create_instruction(SLTIU, arg0_reg, arg0_reg, 1));
     free_register(arg1_reg);
-    free_register(arg0_reg);
 
-    return zero_register;
+    return arg0_reg;
 }
 
 int handle_not(ast_node * node) {
@@ -416,108 +670,104 @@ int handle_not(ast_node * node) {
     printf("Handle NEG\n");
 
     ast_node * arg = get_childlist(node)[0];
-    arg_reg = get_handle_function(arg)(arg);
-    add_instruction(create_instruction(NOT_I, arg_reg, arg_reg, 0));
+    arg_reg = handle_left(arg);
+    add_instruction(create_instruction(SLTIU, arg_reg, arg_reg, 1));
     return arg_reg;
 }
 
-int handle_and(ast_node * node) {
-    printf("Handle AND\n");
-
-    ast_node ** args = get_childlist(node);
-    int arg0_reg;
-    int arg1_reg;
-    int first_and = 0;
-    int last_label;
-
-    if (and_label == -1) {
-        and_label = get_next_label_sn(LABEL_COMPARE_END);
-        first_and = 1;
-    } else {
-    }
-
-    //add_instruction(create_jump_instruction(BEQZ, if_reg, LABEL_ELSE, else_label_sn));
-    if (args[0]->num_children == 0) {
-        arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
-    } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
-        arg1_reg = get_handle_function(args[1])(args[1]);
-    }
+/**
+ * The value of a && b or a || b: 0, set to 1 unless the condition
+ * branches past when it does not hold.
+ * @return: the register holding the value
+ */
+static int handle_logical(ast_node * node) {
+    int dest_reg = allocate_register();
+    int end_sn = get_next_label_sn(LABEL_COMPARE_END);
 
-    add_instruction(create_jump_instruction(BEQZ, arg0_reg, 0, LABEL_COMPARE_END, and_label));
-    add_instruction(create_jump_instruction(BEQZ, arg1_reg, 0, LABEL_COMPARE_END, and_label));
-    add_instruction(create_instruction(LI, arg0_reg, 1, 0));
-
-    if (first_and) {
-        last_label = get_next_label_sn(LABEL_COMPARE_END);
-        add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_COMPARE_END, last_label));
-        add_instruction(create_instruction_label(LABEL_COMPARE_END, and_label));
-        add_instruction(create_instruction(LI, arg0_reg, 0, 0));
-        add_instruction(create_instruction_label(LABEL_COMPARE_END, last_label));
-        and_label = -1;
-    }
+    add_instruction(create_instruction(LI, dest_reg, 0, 0));
+    branch_on(node, 0, LABEL_COMPARE_END, end_sn);
+    add_instruction(create_instruction(LI, dest_reg, 1, 0));
+    add_instruction(create_instruction_label(LABEL_COMPARE_END, end_sn));
 
-    free_register(arg1_reg);
+    return dest_reg;
+}
 
-    return arg0_reg;
+int handle_and(ast_node * node) {
+    printf("Handle AND\n");
+    return handle_logical(node);
 }
 
 int handle_or(ast_node * node) {
     printf("Handle OR\n");
+    return handle_logical(node);
+}
 
-    ast_node ** args = get_childlist(node);
-    int arg0_reg;
-    int arg1_reg;
-    int first_or = 0;
-    int last_label;
-
-    if (or_label == -1) {
-        or_label = get_next_label_sn(LABEL_COMPARE_END);
-        first_or = 1;
-    } else {
-    }
-
-    //add_instruction(create_jump_instruction(BEQZ, if_reg, LABEL_ELSE, else_label_sn));
-    if (args[0]->num_children == 0) {
-        arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
-    } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
-        arg1_reg = get_handle_function(args[1])(args[1]);
-    }
-
-    add_instruction(create_jump_instruction(BNEZ, arg0_reg, 0, LABEL_COMPARE_END, or_label));
-    add_instruction(create_jump_instruction(BNEZ, arg1_reg, 0, LABEL_COMPARE_END, or_label));
-    add_instruction(create_instruction(LI, arg0_reg, 0, 0));
-
-    if (first_or) {
-        last_label = get_next_label_sn(LABEL_COMPARE_END);
-        add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_COMPARE_END, last_label));
-        add_instruction(create_instruction_label(LABEL_COMPARE_END, or_label));
-        add_instruction(create_instruction(LI, arg0_reg, 1, 0));
-        add_instruction(create_instruction_label(LABEL_COMPARE_END, last_label));
-        or_label = -1;
+/**
+ * Emits a plan from strength.h on the value in register x, which is freed.
+ * @return: the register holding the result
+ */
+static int emit_steps(int x, const Step * steps, int count) {
+    int acc, src, temp, i;
+
+    if (count == 0) return x;
+    acc = allocate_register();
+    for (i = 0; i < count; i++) {
+        src = (i == 0) ? x : acc;
+        switch (steps[i].op) {
+            case STEP_SLL:
+                add_instruction(create_instruction(SLL, acc, src, steps[i].imm));
+                break;
+            case STEP_SRA:
+                add_instruction(create_instruction(SRA, acc, src, steps[i].imm));
+                break;
+            case STEP_SRL:
+                add_instruction(create_instruction(SRL, acc, src, steps[i].imm));
+                break;
+            case STEP_ADD_X:
+                add_instruction(create_instruction(ADDU, acc, src, x));
+                break;
+            case STEP_SUB_X:
+                add_instruction(create_instruction(SUBU, acc, src, x));
+                break;
+            case STEP_NEG:
+                add_instruction(create_instruction(SUBU, acc, ZERO, src));
+                break;
+            case STEP_MULHI:
+                temp = allocate_register();
+                add_instruction(create_instruction(LI, temp, steps[i].imm, 0));
+                add_instruction(create_instruction(MULT_I, src, temp, 0));
+                add_instruction(create_instruction(MFHI, acc, 0, 0));
+                free_register(temp);
+                break;
+            case STEP_ADD_SIGN:
+                temp = allocate_register();
+                add_instruction(create_instruction(SRL, temp, src, 31));
+                add_instruction(create_instruction(ADDU, acc, src, temp));
+                free_register(temp);
+                break;
+        }
     }
-
-    free_register(arg1_reg);
-
-    return arg0_reg;
+    free_register(x);
+    return acc;
 }
 
 int handle_div(ast_node * node) {
     printf("Handle Div\n");
 
     ast_node ** args = get_childlist(node);
+    Step steps[MAX_STEPS];
     int arg0_reg;
     int arg1_reg;
+    int count;
 
+    if (args[1]->symbol->token == NUM && (count = plan_divide(args[1]->symbol->value, steps)) >= 0)
+        return emit_steps(get_handle_function(args[0])(args[0]), steps, count);
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
@@ -530,6 +780,8 @@ int handle_div(ast_node * node) {
 
 int handle_plus(ast_node * node) {
     printf("Handle Plus\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int arg0_reg;
@@ -538,9 +790,9 @@ int handle_plus(ast_node * node) {
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
@@ -552,6 +804,8 @@ int handle_plus(ast_node * node) {
 
 int handle_minus(ast_node * node) {
     printf("Handle Minus\n");
+    int immediate_reg = handle_immediate(node);
+    if (immediate_reg >= 0) return immediate_reg;
 
     ast_node ** args = get_childlist(node);
     int num_args = get_num_children(node);
@@ -561,15 +815,15 @@ int handle_minus(ast_node * node) {
     if (num_args == 2) {
         if (args[0]->num_children == 0) {
             arg1_reg = get_handle_function(args[1])(args[1]);
-            arg0_reg = get_handle_function(args[0])(args[0]);
+            arg0_reg = handle_left(args[0]);
         } else {
-            arg0_reg = get_handle_function(args[0])(args[0]);
+            arg0_reg = handle_left(args[0]);
             arg1_reg = get_handle_function(args[1])(args[1]);
         }
         add_instruction(create_instruction(SUB, arg0_reg, arg0_reg, arg1_reg));
         free_register(arg1_reg);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         add_instruction(create_instruction(SUB, arg0_reg, ZERO, arg0_reg));
     }
     return arg0_reg;
@@ -579,15 +833,19 @@ int handle_mult(ast_node * node) {
     printf("Handle Mult\n");
 
     ast_node ** args = get_childlist(node);
+    Step steps[MAX_STEPS];
     int arg0_reg;
     int arg1_reg;
+    int count;
 
+    if (args[1]->symbol->token == NUM && (count = plan_multiply(args[1]->symbol->value, steps)) >= 0)
+        return emit_steps(get_handle_function(args[0])(args[0]), steps, count);
 
     if (args[0]->num_children == 0) {
         arg1_reg = get_handle_function(args[1])(args[1]);
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
     } else {
-        arg0_reg = get_handle_function(args[0])(args[0]);
+        arg0_reg = handle_left(args[0]);
         arg1_reg = get_handle_function(args[1])(args[1]);
     }
 
@@ -603,17 +861,14 @@ int handle_write(ast_node * node) {
     int result_reg = get_handle_function(arg)(arg);
     free_register(result_reg);
     add_instruction(create_instruction(MOVE, a0, result_reg, 0));
-    add_instruction(create_instruction(LI, v0, 1, 0));
-    add_instruction(create_instruction(SYSCALL, 0, 0, 0));
+    add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_WRITE_INT));
 
     return 0;
 }
 
 int handle_writeln(ast_node * node) {
     printf("Handle Writeln\n");
-    add_instruction(create_instruction(LI, v0, 4, 0));
-    add_instruction(create_instruction(LA, a0, 0, 0));
-    add_instruction(create_instruction(SYSCALL, 0, 0, 0));
+    add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_WRITELN));
 
     return 0;
 }
@@ -635,78 +890,149 @@ void handle_stmt_list(ast_node * node) {
     }
 }
 
+/**
+ * @return: 1 if the declaration takes whole words, which must be aligned
+ */
+static int declares_words(ast_node * node) {
+    Symbol * symbol = get_symbol(get_childlist(node)[1]->symbol->sym);
+    return symbol->type == T_INT || (symbol->storage == STORAGE_PARAM && symbol->kind == SYM_ARRAY);
+}
+
+/**
+ * The words of a scope go first and the chars are packed after them, so
+ * every word is aligned and only the end of the scope is padded.
+ */
 void handle_var_decl_list(ast_node * node) {
     printf("Handle VarDeclList\n");
-    int scope_size = 0;
     int i = 0;
     ast_node ** vars = get_childlist(node);
     int num_vars = get_num_children(node);
 
     for (i = 0; i < num_vars; i++) {
-        handle_var_decl(vars[i]);
+        if (declares_words(vars[i])) handle_var_decl(vars[i]);
+    }
+    for (i = 0; i < num_vars; i++) {
+        if (!declares_words(vars[i])) handle_var_decl(vars[i]);
     }
 
-    if ((scope_size = get_scope_size()) > 0)
-        add_instruction(create_instruction(ADDI, sp, sp, -1 * scope_size)); //allocate space for the variables
+    get_scope_size(); // pads the scope, the frame already has room for it
 }
 
 void handle_var_decl(ast_node * node) {
     printf("Handle VarDecl\n");
-    VARTYPE type;
     ast_node ** args = get_childlist(node);
     int num_args = get_num_children(node);
 
-	type = (args[0]->symbol->token == INT) ? T_INT : T_CHAR;
     if (num_args == 2) {
-        add_variable(type, (const char *) args[1]->symbol->lexeme);
+        add_variable(args[1]->symbol->sym);
     } else {
-    	int arr_size = args[2]->symbol->value;
-        add_array(type, (const char *) args[1]->symbol->lexeme, arr_size, 0);
+        add_array(args[1]->symbol->sym);
     }
 }
 
 int handle_block(ast_node * node) {
     printf("Handle Block\n");
-    int scope_size = 0;
 
     add_scope();
     handle_var_decl_list(get_childlist(node)[0]);
     handle_stmt_list(get_childlist(node)[1]);
 
-    if ((scope_size = get_scope_size()) > 0)
-        add_instruction(create_instruction(ADDI, sp, sp, scope_size));
     destroy_scope(1);
 
     return 0;
 }
 
+/**
+ * @return: 1 if the function has a parameter or local, which live in its frame
+ */
+static int has_slots(int fun) {
+    int i;
+
+    for (i = 0; i < get_symbol_count(); i++) {
+        Symbol * symbol = get_symbol(i);
+        if (symbol->function == fun
+                && (symbol->storage == STORAGE_LOCAL || symbol->storage == STORAGE_PARAM))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Turns the slot addresses of a function, emitted from instruction first
+ * on as offsets from $fp, into offsets from $sp, frame_size below it.
+ */
+static void rebase_frame(int first, int frame_size) {
+    int i;
+
+    for (i = first; i < get_instruction_count(); i++) {
+        Instruction_line * l = get_instruction(i);
+        if (l->reg1 != fp) continue;
+        if (l->type == LW || l->type == LB || l->type == SW || l->type == SB) {
+            l->reg1 = sp;
+            l->offset += frame_size;
+        } else if (l->type == ADDI) {
+            l->reg1 = sp;
+            l->reg2 += frame_size;
+        }
+    }
+}
+
+/**
+ * Emits a function.  Its frame is allocated once on entry and every slot,
+ * of a variable or of a register saved around a call, sits at a fixed
+ * offset in it, nested blocks reusing the room of the blocks before them.
+ * Below the slots is the outgoing area for stack arguments, at 4($sp) up,
+ * so $sp does not move in the body.  A leaf without parameters or locals
+ * gets no frame.
+ */
 void handle_fun_decl(ast_node * node) {
 
     printf("Handle FunDecl\n");
     ast_node ** args = get_childlist(node);
-    int type;
-    FunDef dummy;
-    int scope_size = 0;
+    int fun = get_symbol(node->symbol->sym)->function;
+    // only a function that calls another one needs $ra saved
+    int save_ra = !get_call_node(fun)->is_leaf;
+    int has_frame = save_ra || has_slots(fun);
+    Instruction_line * allocate = NULL;
+    int first;
+    int frame_size;
 
-    dummy = lookup_function(args[1]->symbol->lexeme);
-    if (dummy.name != NULL) handle_error("error: function already defined.", node->symbol->line_no);
     add_instruction(create_instruction_named_label(FUNCTION, (const char *) args[1]->symbol->lexeme));
-    add_instruction(create_instruction_text(FUN_PREAMBLE));
-    adjust_stack_height(8);
+    set_function_entry_height(get_current_stack_height());
+    max_stack_height = get_current_stack_height();
+    max_outgoing_size = 0;
+    first = get_instruction_count();
+    if (has_frame) {
+        // the size is only known once the body is emitted
+        allocate = create_instruction(ADDI, sp, sp, 0);
+        add_instruction(allocate);
+    }
+    if (save_ra) {
+        // $ra goes in the word at the entry $sp
+        add_instruction(create_instruction_offset(SW, ra, fp, 0, 0));
+        adjust_stack_height(4);
+    }
 
     add_scope(); //a scope for parameters
-    type = (args[0]->symbol->token == INT) ? T_INT : T_CHAR;
-    define_function(type, (const char *) args[1]->symbol->lexeme);
+    set_current_function(get_function(fun));
     handle_param_decl_list(args[2]);
 
     copy_parameters();
     handle_block(args[3]);
 
-    if ((scope_size = get_scope_size()) > 0)
-        add_instruction(create_instruction(ADDI, sp, sp, scope_size)); //destroy block
     destroy_scope(1);
-    add_instruction(create_instruction_text(FUN_EPILOG));
-    adjust_stack_height(-8);
+    if (strcmp(get_function(fun)->name, "main") == 0)
+        add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_FLUSH));
+    if (save_ra) add_instruction(create_instruction_offset(LW, ra, fp, 0, 0));
+    frame_size = 0;
+    if (has_frame) {
+        frame_size = max_stack_height - function_entry_height + max_outgoing_size;
+        frame_size = (frame_size + 3) / 4 * 4;
+        allocate->reg2 = -1 * frame_size;
+        add_instruction(create_instruction(ADDI, sp, sp, frame_size));
+    }
+    rebase_frame(first, frame_size);
+    add_instruction(create_instruction(JR, ra, 0, 0));
 }
 
 void handle_fun_decl_list(ast_node * node) {
@@ -722,31 +1048,24 @@ void handle_fun_decl_list(ast_node * node) {
 void handle_param_decl_list(ast_node * node) {
     printf("Handle ParamDeclList\n");
     int i = 0;
-    int scope_size = 0;
 
     ast_node ** params = get_childlist(node);
     int num_params = get_num_children(node);
     for (i = num_params-1; i >= 0 ; i--) {
-        handle_param_decl(params[i]);
+        if (declares_words(params[i])) handle_param_decl(params[i]);
+    }
+    for (i = num_params-1; i >= 0 ; i--) {
+        if (!declares_words(params[i])) handle_param_decl(params[i]);
     }
 
-    if ((scope_size = get_scope_size()) > 0)
-        add_instruction(create_instruction(ADDI, sp, sp, -1 * scope_size)); //allocate space for the variables
+    get_scope_size(); // pads the scope, the frame already has room for it
 }
 
 void handle_param_decl(ast_node * node) {
     printf("Handle ParamDecl\n");
-    VARTYPE type;
     ast_node ** args = get_childlist(node);
-    int num_args = get_num_children(node);
-
-	type = (args[0]->symbol->token == INT) ? T_INT : T_CHAR;
-    if (num_args == 2) {
-        add_parameter(type, 0, (const char *) args[1]->symbol->lexeme); // variable
-    } else {
-    	add_parameter(type, 1, (const char *) args[1]->symbol->lexeme); // array
-    }
 
+    add_parameter(args[1]->symbol->sym);
 }
 
 int handle_assign(ast_node * node) {
@@ -757,32 +1076,19 @@ int handle_assign(ast_node * node) {
 
     ast_node ** args = get_childlist(node); // a  = b = c
     info = args[0]->symbol;
-    if (info->token != ID) handle_error("error: incompatible lvalue.", info->line_no);
-
-    if (get_num_children(args[0]) == 0) {
-    	var = lookup_variable(info->lexeme); // var
-    	if (var.offset < 0) {
-     	   handle_error("error: variable undeclared (first use in this function)", info->line_no);
-    	}
-	}
-	else {
-		var = lookup_array(info->lexeme); // array element
-		if (var.offset < 0) {
-    	    handle_error("error: array undeclared (first use in this function)", info->line_no);
-    	}
-	}
+    var = symbol_address(info->sym); // var or array element
 
     arg1_reg = get_handle_function(args[1])(args[1]);
 
 	if (get_num_children(args[0]) == 0) {
-		if (var.size == 1)
-		    add_instruction(create_instruction_offset(SB, arg1_reg, sp, 0, var.offset));
-		else
-		    add_instruction(create_instruction_offset(SW, arg1_reg, sp, 0, var.offset));
+		access_variable(var.size == 1 ? SB : SW, arg1_reg, var);
+    }
+    else if (is_constant_index(get_childlist(args[0])[0], var)) {
+    	access_element(var.size == 1 ? SB : SW, arg1_reg, var, get_childlist(args[0])[0]->symbol->value);
     }
     else {
     	ast_node * index_node = get_childlist(args[0])[0];
-    	int index_reg = get_handle_function(index_node)(index_node);
+    	int index_reg = handle_left(index_node);
     	compute_index(var, index_reg);
     	if (var.size == 1)
     		add_instruction(create_instruction_offset(SB, arg1_reg, index_reg, 0, 0)); // save to array element address
@@ -802,61 +1108,97 @@ int handle_read(ast_node * node) {
 
     ast_node ** args = get_childlist(node); // a  = b = c
     info = args[0]->symbol;
-    if (info->token != ID) handle_error("error: incompatible rvalue.", info->line_no);
-    if ((var = lookup_variable(info->lexeme)).offset < 0) {
-        handle_error("error: variable undeclared (first use in this function)", info->line_no);
-    }
+    var = symbol_address(info->sym);
 
+    add_read(var.size == 1);
+    access_variable(var.size == 1 ? SB : SW, v0, var);
 
-    if (var.size == 1) {
-        add_instruction(create_instruction(LI, v0, 12, 0));
-        add_instruction(create_instruction(SYSCALL, 0, 0, 0));
-        add_instruction(create_instruction_offset(SB, v0, sp, 0, var.offset));
-    } else {
-        add_instruction(create_instruction(LI, v0, 5, 0));
-        add_instruction(create_instruction(SYSCALL, 0, 0, 0));
-        add_instruction(create_instruction_offset(SW, v0, sp, 0, var.offset));
+    return 0;
+
+}
+
+/**
+ * Evaluates one call argument; an array is passed as the address of its
+ * element 0, nothing is copied.
+ * @return: the register holding the value
+ */
+static int handle_argument(ast_node * arg) {
+    int reg;
+
+    if (arg->symbol->token == ID && get_num_children(arg) == 0
+            && get_symbol(arg->symbol->sym)->kind == SYM_ARRAY) {
+        reg = allocate_register();
+        load_array_base(symbol_address(arg->symbol->sym), reg);
+        return reg;
     }
+    return get_handle_function(arg)(arg);
+}
 
-    return 0;
+/**
+ * @return: 1 if the expression contains a call
+ */
+static int contains_call(ast_node * node) {
+    int i;
 
+    if (is_call_node(node)) return 1;
+    for (i = 0; i < get_num_children(node); i++)
+        if (contains_call(get_childlist(node)[i])) return 1;
+    return 0;
 }
 
-int handle_expr_list(ast_node * node, FunDef fun) {
+/**
+ * Evaluates the arguments of a call.  The first ARG_REGISTER_COUNT end up
+ * in $a0-$a3, the rest in the outgoing area at 4($sp) up, in order, one
+ * word each.  When another argument contains a call, which would use the
+ * same area, stack arguments wait in frame slots and are copied down once
+ * every argument is evaluated.
+ * Stack arguments are evaluated first, so at most ARG_REGISTER_COUNT values
+ * are held in temporaries, and the register arguments are only moved into
+ * $a0-$a3 once all of them are evaluated, so calls nested in the arguments
+ * cannot clobber them.
+ */
+int handle_expr_list(ast_node * node, FunDef * fun) {
     printf("Handle ExprList\n");
     ast_node ** args = get_childlist(node);
     int num_args = get_num_children(node);
+    int arg_regs[ARG_REGISTER_COUNT];
+    int stack_size = get_stack_argument_size(fun);
+    int staged = 0;
+    int stage_height = get_current_stack_height();
     int reg;
     int i;
-    int is_array = 0;
-
-    if (num_args < fun.param_count) handle_error("error: too few arguments to function", node->symbol->line_no);
-    if (num_args > fun.param_count) handle_error("error: too many arguments to function", node->symbol->line_no);
-
-    for (i = 0; i < fun.param_count; i++) {
-        VarAddress var;
-        var = lookup_variable(args[i]->symbol->lexeme);
-        if (var.offset < 0) {
-        	var = lookup_array(args[i]->symbol->lexeme);
-        	if (var.offset >= 0)
-        		is_array = 1;
-		}
-        if (var.offset >= 0) {
-            if (var.size != (fun.param_type[i] == T_INT ? 4 : 1)) {
-                handle_error("error: non-matching argument types", node->symbol->line_no);
-            }
-        }
 
-        if (is_array) {
-        	if (var.offset < 0) {
-		        handle_error("error: array undeclared (first use in this function)", node->symbol->line_no);
-		    }
-        } else {
-        	reg = get_handle_function(args[i])(args[i]);
-        	add_instruction(create_instruction(MOVE, 4 + i, reg, 0));
+    if (stack_size > max_outgoing_size) max_outgoing_size = stack_size;
+    for (i = 0; i < num_args && stack_size > 0; i++)
+        if (contains_call(args[i])) staged = 1;
+    if (staged) adjust_stack_height(stack_size);
+
+    for (i = ARG_REGISTER_COUNT; i < num_args; i++) {
+        reg = handle_argument(args[i]);
+        if (staged)
+            add_instruction(create_instruction_offset(SW, reg, fp, 0,
+                    function_entry_height - stage_height - 4 * (i - ARG_REGISTER_COUNT)));
+        else
+            add_instruction(create_instruction_offset(SW, reg, sp, 0, 4 * (i - ARG_REGISTER_COUNT + 1)));
+        free_register(reg);
+    }
+    for (i = 0; i < num_args && i < ARG_REGISTER_COUNT; i++) {
+        arg_regs[i] = handle_argument(args[i]);
+    }
+    if (staged) {
+        reg = allocate_register();
+        for (i = ARG_REGISTER_COUNT; i < num_args; i++) {
+            add_instruction(create_instruction_offset(LW, reg, fp, 0,
+                    function_entry_height - stage_height - 4 * (i - ARG_REGISTER_COUNT)));
+            add_instruction(create_instruction_offset(SW, reg, sp, 0, 4 * (i - ARG_REGISTER_COUNT + 1)));
         }
+        free_register(reg);
+        adjust_stack_height(-1 * stack_size);
+    }
+    for (i = 0; i < num_args && i < ARG_REGISTER_COUNT; i++) {
+        add_instruction(create_instruction(MOVE, a0 + i, arg_regs[i], 0));
+        free_register(arg_regs[i]);
     }
-    free_register(reg);
     return 0;
 }
 
@@ -867,58 +1209,73 @@ void handle_program(ast_node * node) {
     int num_children = get_num_children(node);
     add_scope();
     for (i = num_children - 1; i > 0; i--) {
-        handle_var_decl(args[i]);
+        add_global(get_childlist(args[i])[1]->symbol->sym);
     }
     handle_fun_decl_list(args[i]);
     destroy_scope(1);
 }
 
-void handle_error(const char * msg, int line) {
-    fprintf(stderr, "Line %d: %s\n", line + 1, msg);
-    while (destroy_scope(0) >= 0); //cleanup
-    exit(1);
-}
-
-int call_function(ast_node * node) {
-    FunDef fun = lookup_function(node->symbol->lexeme);
+/**
+ * Calls the function of an ID node; the result is left in $v0 for
+ * dest_reg, which is therefore not saved around the call.
+ */
+int call_function(ast_node * node, int dest_reg) {
+    FunDef * fun = get_function(get_symbol(node->symbol->sym)->function);
+    int saved;
 
-    if (fun.name == NULL) handle_error("error: function not declared.", node->symbol->line_no);
     //backup_params(&fun);
 
+    saved = save_registers(dest_reg);
     handle_expr_list(get_childlist(node)[0], fun);
-    save_registers();
-    add_instruction(create_jump_label_instruction(JAL, 0, 0, fun.name));
-    restore_registers();
+    add_instruction(create_jump_label_instruction(JAL, 0, 0, fun->name));
+    restore_registers(saved);
     return 0;
 }
 
-void save_registers() {
+/**
+ * @return: bytes of outgoing stack space needed to call fun
+ */
+int get_stack_argument_size(FunDef * fun) {
+    if (fun->param_count <= ARG_REGISTER_COUNT) return 0;
+    return 4 * (fun->param_count - ARG_REGISTER_COUNT);
+}
+
+/**
+ * Stores the temporaries holding a value, that is every allocated one
+ * but dest_reg, in frame slots above the current stack height.
+ * @return: mask of the saved registers, bit i for $t<i>
+ */
+int save_registers(int dest_reg) {
+    int saved = 0;
     int i;
-    add_instruction(create_instruction(ADDI, sp, sp, -1 * 32)); //allocate space for the registers
+
     for (i = 0; i < REGISTER_COUNT; i++) {
-        add_instruction(create_instruction_offset(SW, i + REGISTER_T_OFFSET, sp, 0, 4+i * 4));
+        if (registers[i] == 1 || i + REGISTER_T_OFFSET == dest_reg) continue;
+        saved |= 1 << i;
+        add_instruction(create_instruction_offset(SW, i + REGISTER_T_OFFSET, fp, 0,
+                function_entry_height - get_current_stack_height()));
+        adjust_stack_height(4);
     }
-    adjust_stack_height(32);
+    return saved;
 }
 
-void restore_registers() {
+void restore_registers(int saved) {
     int i;
-    for (i = 0; i < REGISTER_COUNT; i++) {
-        add_instruction(create_instruction_offset(LW, i + REGISTER_T_OFFSET, sp, 0, 4+i * 4));
+
+    for (i = REGISTER_COUNT - 1; i >= 0; i--) {
+        if (!(saved & (1 << i))) continue;
+        adjust_stack_height(-4);
+        add_instruction(create_instruction_offset(LW, i + REGISTER_T_OFFSET, fp, 0,
+                function_entry_height - get_current_stack_height()));
     }
-    add_instruction(create_instruction(ADDI, sp, sp, 1 * 32)); //restore the stack pointer
-    adjust_stack_height(-32);
 }
 
 void backup_params(FunDef * fun) {
 }
 
-#define FUNCTIONS_SIZE 50
-
 typedef struct Scope {
-    Symentry * variables;
-    int variables_count;
-    int variables_max;
+    int declared;       // number of variables declared in this scope
+    int base_height;    // stack height when the scope was opened
     struct Scope * parent;
 } Scope;
 
@@ -926,15 +1283,30 @@ typedef struct Scope {
 int current_stack_height = 0;
 Scope * current_scope = NULL;
 FunDef * current_function = NULL;
-FunDef functions[FUNCTIONS_SIZE];
-int functions_count = 0;
+
+// stack height of every Symbol, and the static data label of every global,
+// indexed like the semantic symbol table
+int * symbol_heights = NULL;
+const char ** global_labels = NULL;
+
+void init_symbol_heights() {
+    int count = get_symbol_count();
+    symbol_heights = (int *) calloc(count > 0 ? count : 1, sizeof (int));
+    global_labels = (const char **) calloc(count > 0 ? count : 1, sizeof (const char *));
+}
+
+void destroy_symbol_heights() {
+    free(symbol_heights);
+    free(global_labels);
+    symbol_heights = NULL;
+    global_labels = NULL;
+}
 
 void add_scope() {
     Scope * scope = (Scope *) malloc(sizeof (Scope));
 
-    scope->variables = NULL;
-    scope->variables_count = 0;
-    scope->variables_max = 0;
+    scope->declared = 0;
+    scope->base_height = current_stack_height;
     scope->parent = current_scope;
     current_scope = scope;
 }
@@ -943,77 +1315,60 @@ int destroy_scope(int verbose) {
     if (verbose) ;
     Scope * scope = current_scope;
     if (scope == NULL) return -1;
+    // the slots of a closed scope are free for the next one
+    current_stack_height = scope->base_height;
     current_scope = scope->parent;
-    free(scope->variables);
     free(scope);
     return 0;
 }
 
-static void extend_scope() {
-    int new_size;
-    if (current_scope->variables_max > 0) {
-        new_size = current_scope->variables_max * 2;
-        current_scope->variables = (Symentry *) realloc(current_scope->variables, new_size * sizeof (Symentry));
-    } else {
-        new_size = 2;
-        current_scope->variables = (Symentry *) malloc(new_size * sizeof (Symentry));
-    }
-    current_scope->variables_max = new_size;
-}
-
 static int get_var_size(VARTYPE type)
 {
 	return (type == T_INT) ? 4 : 1;
 }
 
-static void add_variable_to_scope(Symentry entry) {
-    int x = current_scope->variables_count++;
-    current_scope->variables[x] = entry;
+static void place_symbol(int sym, int stack_height) {
+    symbol_heights[sym] = stack_height;
+    current_scope->declared++;
 }
 
-static Symentry create_symentry(const char * name, int size, int stack_height, int is_array, int count)
-{
-	Symentry entry;
-	entry.name = name;
-    entry.size = size;
-    entry.stack_height = stack_height;
-    entry.is_array = is_array;
-    entry.count = count;
-    return entry;
+void add_variable(int sym) {
+    int size = get_var_size(get_symbol(sym)->type);
+    place_symbol(sym, current_stack_height);
+    adjust_stack_height(size);
 }
 
-static void extend_scope_if_needed()
+void add_array(int sym)
 {
-	if (current_scope->variables_count >= current_scope->variables_max)
-        extend_scope();
+	Symbol * symbol = get_symbol(sym);
+	place_symbol(sym, current_stack_height);
+	adjust_stack_height(get_var_size(symbol->type) * symbol->count);
 }
 
-void add_variable(VARTYPE type, const char * name) {
-    int size = get_var_size(type);
-    extend_scope_if_needed();
-    add_variable_to_scope(create_symentry(name, size, current_stack_height, 0, 1));
-    current_stack_height += size;
-}
+/**
+ * Globals are not on the stack: each gets static data, so its address does
+ * not depend on the frames below it.
+ */
+void add_global(int sym) {
+    Symbol * symbol = get_symbol(sym);
+    int size = get_var_size(symbol->type);
 
-void add_array(VARTYPE type, const char * name, int arr_size, int reference)
-{
-	int size = get_var_size(type);
-    extend_scope_if_needed();
-    add_variable_to_scope(create_symentry(name, size, current_stack_height, 1, arr_size));
-    current_stack_height += size * arr_size;
+    if (symbol->kind == SYM_ARRAY) size *= symbol->count;
+    global_labels[sym] = codetable_add_data(symbol->name, size);
 }
 
 int get_scope_size() {
     int size, padding;
-    if (current_scope->variables_count == 0) return 0;
-    size = current_stack_height - current_scope->variables[0].stack_height;
+    if (current_scope->declared == 0) return 0;
+    size = current_stack_height - current_scope->base_height;
     padding = (4 - size % 4) % 4;
-    current_stack_height += padding;
+    adjust_stack_height(padding);
     return size + padding;
 }
 
 void adjust_stack_height(int offset) {
     current_stack_height += offset;
+    if (current_stack_height > max_stack_height) max_stack_height = current_stack_height;
 }
 
 int get_current_stack_height() {
@@ -1021,158 +1376,67 @@ int get_current_stack_height() {
 }
 
 /**
- * @return: offset of the variable from the top of the stack
+ * A Symbol placed at height h takes the bytes below the word at height h,
+ * so a word at h sits at offset entry height - h and the bytes of an array
+ * run upwards from its lowest address.
+ * @return: offset of the variable or of element 0 of the array from $fp
  */
-VarAddress lookup_variable(const char * name) {
-    Scope * current = current_scope;
-    int i;
+VarAddress symbol_address(int sym) {
     VarAddress var;
-
-    while (current != NULL) {
-        for (i = 0; i < current->variables_count; i++) {
-            if (!strcmp(current->variables[i].name, name) && !current->variables[i].is_array) {
-                var.offset = current_stack_height - current->variables[i].stack_height;
-                var.size = current->variables[i].size;
-                var.count = current->variables[i].count;
-
-                return var;
-            }
-        }
-        current = current->parent;
-    }
-    var.offset = -1;
-    var.size = -1;
-
+    Symbol * symbol = get_symbol(sym);
+    int span = get_var_size(symbol->type) * (symbol->kind == SYM_ARRAY ? symbol->count : 1);
+
+    // a parameter passed on the stack fills a word, a char in its low
+    // byte, and an array parameter is the word holding its address
+    var.indirect = (symbol->storage == STORAGE_PARAM && symbol->kind == SYM_ARRAY);
+    if (var.indirect || (symbol->storage == STORAGE_PARAM && symbol->param_index >= ARG_REGISTER_COUNT))
+        span = 4;
+    var.offset = function_entry_height + 4 - symbol_heights[sym] - span;
+    var.label = global_labels[sym];
+    var.size = get_var_size(symbol->type);
+    var.count = symbol->count;
     return var;
 }
 
-/**
- * @return: offset of the array from the top of the stack
- */
-VarAddress lookup_array(const char * name) {
-    Scope * current = current_scope;
-    int i;
-    VarAddress arr;
-
-    while (current != NULL) {
-        for (i = 0; i < current->variables_count; i++) {
-            if (!strcmp(current->variables[i].name, name) && current->variables[i].is_array) {
-                arr.offset = current_stack_height - current->variables[i].stack_height;
-                arr.size = current->variables[i].size;
-                arr.count = current->variables[i].count;
-
-                return arr;
-            }
-        }
-        current = current->parent;
-    }
-    arr.offset = -1;
-    arr.size = -1;
-
-    return arr;
-}
-
-VarAddress lookup_variable_in_current_scope(const char * name) {
-    int i;
-    VarAddress var;
-
-    for (i = 0; i < current_scope->variables_count; i++) {
-        if (!strcmp(current_scope->variables[i].name, name) && !current_scope->variables[i].is_array) {
-            var.offset = current_stack_height - current_scope->variables[i].stack_height;
-            var.size = current_scope->variables[i].size;
-            var.count = current_scope->variables[i].count;
-
-            return var;
-        }
-    }
-    var.offset = -1;
-    var.size = -1;
-
-    return var;
-}
-
-VarAddress lookup_array_in_current_scope(const char * name) {
-    int i;
-    VarAddress arr;
-
-    for (i = 0; i < current_scope->variables_count; i++) {
-        if (!strcmp(current_scope->variables[i].name, name) && current_scope->variables[i].is_array) {
-            arr.offset = current_stack_height - current_scope->variables[i].stack_height;
-            arr.size = current_scope->variables[i].size;
-            arr.count = current_scope->variables[i].count;
-
-            return arr;
-        }
-    }
-    arr.offset = -1;
-    arr.size = -1;
-
-    return arr;
-}
-
-void set_array_stack_height_in_current_scope(const char * name, int stack_height) {
-	int i;
-	for (i = 0; i < current_scope->variables_count; i++) {
-        if (!strcmp(current_scope->variables[i].name, name) && current_scope->variables[i].is_array) {
-        	current_scope->variables[i].stack_height = stack_height;
-        	return;
-        }
-    }
-}
-
 /***FUNCTIONS***/
-FunDef define_function(VARTYPE type, const char * name) {
-    FunDef function;
-
-    function.name = name;
-    function.type = type;
-    function.param_count = 0;
-    functions[functions_count] = function;
-    set_current_function(&(functions[functions_count++]));
-
-    return function;
+void set_current_function(FunDef * fun) {
+    current_function = fun;
 }
 
-FunDef lookup_function(const char* name) {
-    int i;
-    FunDef dummy;
-    for (i = 0; i < functions_count; i++) {
-        if (!strcmp(functions[i].name, name)) {
-            return functions[i];
-        }
+/**
+ * Parameters past the first ARG_REGISTER_COUNT are not copied; they stay
+ * in the caller's outgoing area, one word each, starting at 4($sp) on
+ * entry.
+ */
+void add_parameter(int sym) {
+    Symbol * symbol = get_symbol(sym);
+    int index = symbol->param_index;
+
+    if (index >= ARG_REGISTER_COUNT) {
+        place_symbol(sym, function_entry_height - 4 * (index - ARG_REGISTER_COUNT + 1));
+    } else if (symbol->kind == SYM_ARRAY) {
+        // only the address of element 0 is passed
+        place_symbol(sym, current_stack_height);
+        adjust_stack_height(4);
+    } else {
+    	add_variable(sym);
     }
-    dummy.name = NULL;
-    return dummy;
-}
 
-void set_current_function(FunDef * fun) {
-    current_function = fun;
 }
 
-void add_parameter(VARTYPE type, int is_array, const char * name) {
-    current_function->param_type[current_function->param_count] = type;
-    current_function->is_array[current_function->param_count] = is_array;
-    current_function->param_name[current_function->param_count++] = name;
-    if (is_array)
-    	add_array(type, name, 0, 1);
-    else
-    	add_variable(type, name);
-
+void set_function_entry_height(int height) {
+    function_entry_height = height;
 }
 
 void copy_parameters() {
     int i;
     VarAddress var;
 
-    for (i = 0; i < current_function->param_count; i++) {
-    	if (current_function->is_array[i]) {
-        	var = lookup_array_in_current_scope(current_function->param_name[i]);
-        } else {
-        	var = lookup_variable_in_current_scope(current_function->param_name[i]);
-		    if (var.size == 1)
-		        add_instruction(create_instruction_offset(SB, 4 + i, sp, 0, var.offset));
-		    else
-		        add_instruction(create_instruction_offset(SW, 4 + i, sp, 0, var.offset));
-        }
+    for (i = 0; i < current_function->param_count && i < ARG_REGISTER_COUNT; i++) {
+    	var = symbol_address(current_function->params[i]);
+	    if (var.size == 1 && !var.indirect)
+	        add_instruction(create_instruction_offset(SB, 4 + i, fp, 0, var.offset));
+	    else
+	        add_instruction(create_instruction_offset(SW, 4 + i, fp, 0, var.offset));
     }
 }
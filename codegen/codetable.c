@@ -6,10 +6,6 @@
 #include <string.h>
 #include "codetable.h"
 
-#define FUNCTION_BEGIN "addiu\t$sp,\t$sp,\t-8\nsw\t$ra,\t8($sp)\nsw\t$fp,\t4($sp)\n"
-
-#define FUNCTION_END "\nlw\t$ra,\t8($sp)\nlw\t$fp,\t4($sp)\naddiu\t$sp,\t$sp,\t8\njr\t$ra\n"
-
 const char * label_string[] = {
     "if",
     "else",
@@ -18,8 +14,8 @@ const char * label_string[] = {
     "while_end",
     "compare",
     "compare_end",
-    "function",
-    "text"
+    "block",
+    "function"
 };
 
 // Define MIPS instructions
@@ -51,8 +47,27 @@ const char * instruction_type_string[] = {
     "bnez",
     "sb",
     "lb",
-    "text",
-    "jal"
+    "jr",
+    "jal",
+    "beq",
+    "bne",
+    "sll",
+    "sra",
+    "srl",
+    "mult",
+    "mfhi",
+    "slti",
+    "sltiu",
+    "sltu",
+    "xori",
+    "blt",
+    "bgt",
+    "bltz",
+    "bgez",
+    "blez",
+    "bgtz",
+    "addu",
+    "subu"
 };
 
 // Define instruction counts
@@ -84,20 +99,55 @@ const int instruction_reg_count[] = {
     1,
     2,
     2,
+    1,
     0,
-    0
+    2,
+    2,
+    3,
+    3,
+    3,
+    2,
+    1,
+    3,
+    3,
+    3,
+    3,
+    2,
+    2,
+    1,
+    1,
+    1,
+    1,
+    3,
+    3
 };
 
 int instruction_capacity = 1000;
 int instruction_count;
 Instruction_line ** instructions = NULL;
-int label_sn_if = 0;
-int label_sn_else = 0;
-int label_sn_if_else_end = 0;
-int label_sn_while = 0;
-int label_sn_while_end = 0;
-int label_sn_compare = 0;
-int label_sn_compare_end = 0;
+
+// next serial number of each numbered label kind; the kind and serial
+// number only name a label in the output, its id identifies it
+int next_label_sn[LABEL_BLOCK + 1];
+
+// id of each numbered label, per kind, indexed by serial number
+int * label_ids[LABEL_BLOCK + 1];
+int label_ids_max[LABEL_BLOCK + 1];
+int label_count = 0;
+
+// statically allocated data, printed after _newline_ in the .data section
+typedef struct {
+    char * label;
+    int size;
+    int small;      // declared .extern and addressed from $gp
+} Data_entry;
+
+Data_entry * data_entries = NULL;
+int data_count = 0;
+int data_max = 0;
+
+// read statements call the input runtime instead of a syscall per value
+int buffered_input = 0;
 
 void codetable_init() {
     instruction_count = 0;
@@ -114,44 +164,70 @@ void codetable_destroy() {
     }
     instructions = NULL;
     instruction_count = 0;
+    for (i = 0; i < data_count; i++) {
+        free(data_entries[i].label);
+    }
+    free(data_entries);
+    data_entries = NULL;
+    data_count = data_max = 0;
+    for (i = 0; i <= LABEL_BLOCK; i++) {
+        free(label_ids[i]);
+        label_ids[i] = NULL;
+        label_ids_max[i] = 0;
+        next_label_sn[i] = 0;
+    }
+    label_count = 0;
 }
 
 int get_next_label_sn(Label_type label) {
+    int sn;
+
     switch (label) {
-        case LABEL_IF:
-            return label_sn_if++;
-        case LABEL_ELSE:
-            return label_sn_else++;
-        case LABEL_IF_ELSE_END:
-            return label_sn_if_else_end++;
-        case LABEL_WHILE:
-            return label_sn_while++;
-        case LABEL_WHILE_END:
-            return label_sn_while_end++;
-        case LABEL_COMPARE:
-            return label_sn_compare++;
-        case LABEL_COMPARE_END:
-            return label_sn_compare_end++;
         case FUNCTION:
-        case FUN_PREAMBLE:
-        case FUN_EPILOG:
             return 0;
-
-
+        default:
+            break;
     }
-    printf("Unknown label\n");
-    return -1;
+    if (label < 0 || label > LABEL_BLOCK) {
+        printf("Unknown label\n");
+        return -1;
+    }
+    sn = next_label_sn[label]++;
+    if (sn >= label_ids_max[label]) {
+        label_ids_max[label] = label_ids_max[label] > 0 ? label_ids_max[label] * 2 : 64;
+        label_ids[label] = realloc(label_ids[label], sizeof (int) * label_ids_max[label]);
+    }
+    label_ids[label][sn] = label_count++;
+    return sn;
 }
 
 int get_last_label_sn(Label_type label) {
     switch (label) {
         case LABEL_WHILE_END:
-            return label_sn_while_end - 1;
+            return next_label_sn[LABEL_WHILE_END] - 1;
         default:
             return 0;
     }
 }
 
+int get_label_id(Label_type label, int label_sn) {
+    if (label < 0 || label > LABEL_BLOCK || label_sn < 0 || label_sn >= next_label_sn[label])
+        return -1;
+    return label_ids[label][label_sn];
+}
+
+int get_label_count() {
+    return label_count;
+}
+
+int get_instruction_count() {
+    return instruction_count;
+}
+
+Instruction_line * get_instruction(int index) {
+    return instructions[index];
+}
+
 Instruction_line * create_instruction(Instruction_type type, int dest_reg, int reg1, int reg2) {
     Instruction_line * line = NULL;
     line = malloc(sizeof (Instruction_line));
@@ -164,6 +240,8 @@ Instruction_line * create_instruction(Instruction_type type, int dest_reg, int r
     line->offset = -1;
     line->label = 0;
     line->label_sn = -1;
+    line->label_name = NULL;
+    line->label_id = -1;
 
     return line;
 }
@@ -180,6 +258,8 @@ Instruction_line * create_jump_instruction(Instruction_type type, int dest_reg,
     line->offset = -1;
     line->label = label;
     line->label_sn = label_sn;
+    line->label_name = NULL;
+    line->label_id = get_label_id(label, label_sn);
 
     return line;
 }
@@ -196,6 +276,8 @@ Instruction_line * create_instruction_label(Label_type label, int label_sn) {
     line->offset = -1;
     line->label = label;
     line->label_sn = label_sn;
+    line->label_name = NULL;
+    line->label_id = get_label_id(label, label_sn);
 
     return line;
 }
@@ -213,39 +295,43 @@ Instruction_line * create_jump_label_instruction(Instruction_type type, int dest
     line->label = 0;
     line->label_sn = 0;
     line->label_name = name;
+    line->label_id = -1;
 
     return line;
 }
 
-Instruction_line * create_instruction_named_label(Label_type label, const char * name) {
+Instruction_line * create_instruction_data(Instruction_type type, int reg, const char * label, int offset) {
     Instruction_line * line = NULL;
     line = malloc(sizeof (Instruction_line));
     if (line == NULL) return NULL; //ERROR!!!
 
-    line->type = LABEL;
-    line->dest_reg = 0;
-    line->reg1 = 0;
+    line->type = type;
+    line->dest_reg = reg;
+    line->reg1 = gp;
     line->reg2 = 0;
-    line->offset = -1;
-    line->label = label;
-    line->label_sn = 0;
-    line->label_name = name;
+    line->offset = offset;
+    line->label = 0;
+    line->label_sn = -1;
+    line->label_name = label;
+    line->label_id = -1;
 
     return line;
 }
 
-Instruction_line * create_instruction_text(Label_type label) {
+Instruction_line * create_instruction_named_label(Label_type label, const char * name) {
     Instruction_line * line = NULL;
     line = malloc(sizeof (Instruction_line));
     if (line == NULL) return NULL; //ERROR!!!
 
-    line->type = TEXT;
+    line->type = LABEL;
     line->dest_reg = 0;
     line->reg1 = 0;
     line->reg2 = 0;
     line->offset = -1;
     line->label = label;
     line->label_sn = 0;
+    line->label_name = name;
+    line->label_id = label_count++;
 
     return line;
 }
@@ -262,15 +348,48 @@ Instruction_line * create_instruction_offset(Instruction_type type, int dest_reg
     line->offset = offset;
     line->label = 0;
     line->label_sn = -1;
+    line->label_name = NULL;
+    line->label_id = -1;
 
     return line;
 }
 
 void add_instruction(Instruction_line * line) {
-    // TODO: check for overflow
+    if (instruction_count >= instruction_capacity) {
+        instruction_capacity *= 2;
+        instructions = realloc(instructions, sizeof (Instruction_line*) * instruction_capacity);
+    }
     instructions[instruction_count++] = line;
 }
 
+/**
+ * Reserves size bytes, word aligned, in the small data area or the .data
+ * section.
+ * @return: the label of the data, owned by the codetable
+ */
+const char * codetable_add_data(const char * name, int size) {
+    Data_entry * entry;
+
+    if (data_count >= data_max) {
+        data_max = data_max > 0 ? data_max * 2 : 16;
+        data_entries = realloc(data_entries, sizeof (Data_entry) * data_max);
+    }
+    entry = &data_entries[data_count++];
+    entry->label = malloc(strlen(name) + 4);
+    sprintf(entry->label, "_g_%s", name);
+    entry->size = size > 0 ? (size + 3) / 4 * 4 : 4;
+    entry->small = entry->size <= SMALL_DATA_SIZE;
+    return entry->label;
+}
+
+int codetable_is_small_data(const char * label) {
+    int i;
+
+    for (i = 0; i < data_count; i++)
+        if (data_entries[i].label == label) return data_entries[i].small;
+    return 0;
+}
+
 void stack_push(int reg) {
     add_instruction(create_instruction(ADDI, sp, sp, -4));
     add_instruction(create_instruction_offset(SW, reg, sp, 0, 0));
@@ -285,80 +404,388 @@ void stack_pop(int reg) {
     //addi $sp, $sp, 4   # Increment stack pointer by 4
 }
 
+int add_prologue(int frame_size, int save_ra) {
+    int size = frame_size + (save_ra ? 4 : 0);
+
+    if (size == 0) return 0;
+    add_instruction(create_instruction(ADDI, sp, sp, -1 * size));
+    if (save_ra) add_instruction(create_instruction_offset(SW, ra, sp, 0, size));
+    return size;
+}
+
+void add_epilogue(int frame_size, int save_ra) {
+    int size = frame_size + (save_ra ? 4 : 0);
+
+    if (save_ra) add_instruction(create_instruction_offset(LW, ra, sp, 0, size));
+    if (size > 0) add_instruction(create_instruction(ADDI, sp, sp, size));
+    add_instruction(create_instruction(JR, ra, 0, 0));
+}
+
+int is_immediate(long long value) {
+    return value >= IMMEDIATE_MIN && value <= IMMEDIATE_MAX;
+}
+
+int is_runtime_routine(const char * name) {
+    return strcmp(name, RUNTIME_WRITE_INT) == 0 || strcmp(name, RUNTIME_WRITELN) == 0
+        || strcmp(name, RUNTIME_FLUSH) == 0 || strcmp(name, RUNTIME_READ_INT) == 0
+        || strcmp(name, RUNTIME_READ_CHAR) == 0;
+}
+
+void codetable_set_buffered_input(int on) {
+    buffered_input = on;
+}
+
+void add_read(int is_char) {
+    if (buffered_input) {
+        // the runtime flushes the output when it has to wait for input
+        add_instruction(create_jump_label_instruction(JAL, 0, 0,
+                is_char ? RUNTIME_READ_CHAR : RUNTIME_READ_INT));
+        return;
+    }
+    // what was written so far shows before the program waits
+    add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_FLUSH));
+    add_instruction(create_instruction(LI, v0, is_char ? 12 : 5, 0));
+    add_instruction(create_instruction(SYSCALL, 0, 0, 0));
+}
+
 void print_preamble(FILE * out) {
+    int i;
+
     fprintf(out, ".data\n"
             "_newline_:\n"
-            ".asciiz	\"\\n\"\n"
-            ".text\n"
+            ".asciiz	\"\\n\"\n");
+    fprintf(out, ".extern _out_pos 4\n"
+            "_out_digits:\n"
+            ".space 12\n"
+            "_out_buf:\n"
+            ".space %d\n", OUT_BUFFER_SIZE);
+    if (buffered_input)
+        fprintf(out, ".extern _in_pos 4\n"
+                ".extern _in_end 4\n"
+                "_in_buf:\n"
+                ".space %d\n", IN_BUFFER_SIZE);
+    for (i = 0; i < data_count; i++) {
+        if (data_entries[i].small)
+            fprintf(out, ".extern %s %d\n", data_entries[i].label, data_entries[i].size);
+        else
+            fprintf(out, ".align 2\n%s:\n.space %d\n", data_entries[i].label, data_entries[i].size);
+    }
+    fprintf(out, ".text\n"
             ".globl main\n\n");
 }
 
+/**
+ * Prints the output runtime.  _out_pos bytes of _out_buf are in use and
+ * one more is always left for the terminating NUL.  A number is formatted
+ * backwards into _out_digits and copied to the buffer; it takes at most
+ * 11 bytes.
+ */
+static void print_runtime(FILE * out) {
+    fprintf(out, "\n%s:\n"
+            "addi\t$sp,\t$sp,\t-20\n"
+            "sw\t$t0,\t4($sp)\n"
+            "sw\t$t1,\t8($sp)\n"
+            "sw\t$t2,\t12($sp)\n"
+            "sw\t$t3,\t16($sp)\n"
+            "lw\t$t0,\t_out_pos\n"
+            "slti\t$t1,\t$t0,\t%d\n"
+            "bnez\t$t1,\t_write_int_room\n"
+            "move\t$t3,\t$a0\n"
+            "sw\t$ra,\t20($sp)\n"
+            "jal\t%s\n"
+            "lw\t$ra,\t20($sp)\n"
+            "move\t$a0,\t$t3\n"
+            "li\t$t0,\t0\n"
+            "_write_int_room:\n"
+            "la\t$t1,\t_out_buf\n"
+            "add\t$t1,\t$t1,\t$t0\n"
+            "bgez\t$a0,\t_write_int_digits\n"
+            "li\t$t2,\t45\n"
+            "sb\t$t2,\t0($t1)\n"
+            "addi\t$t1,\t$t1,\t1\n"
+            "subu\t$a0,\t$zero,\t$a0\n"
+            "_write_int_digits:\n"
+            "la\t$t2,\t_out_digits+12\n"
+            "li\t$t3,\t10\n"
+            "_write_int_divide:\n"
+            "divu\t$a0,\t$t3\n"
+            "mfhi\t$t0\n"
+            "mflo\t$a0\n"
+            "addi\t$t0,\t$t0,\t48\n"
+            "addi\t$t2,\t$t2,\t-1\n"
+            "sb\t$t0,\t0($t2)\n"
+            "bnez\t$a0,\t_write_int_divide\n"
+            "la\t$t3,\t_out_digits+12\n"
+            "_write_int_copy:\n"
+            "lb\t$t0,\t0($t2)\n"
+            "sb\t$t0,\t0($t1)\n"
+            "addi\t$t2,\t$t2,\t1\n"
+            "addi\t$t1,\t$t1,\t1\n"
+            "bne\t$t2,\t$t3,\t_write_int_copy\n"
+            "la\t$t0,\t_out_buf\n"
+            "sub\t$t0,\t$t1,\t$t0\n"
+            "sw\t$t0,\t_out_pos\n"
+            "lw\t$t0,\t4($sp)\n"
+            "lw\t$t1,\t8($sp)\n"
+            "lw\t$t2,\t12($sp)\n"
+            "lw\t$t3,\t16($sp)\n"
+            "addi\t$sp,\t$sp,\t20\n"
+            "jr\t$ra\n",
+            RUNTIME_WRITE_INT, OUT_BUFFER_SIZE - 12, RUNTIME_FLUSH);
+    fprintf(out, "\n%s:\n"
+            "lw\t$v0,\t_out_pos\n"
+            "slti\t$a0,\t$v0,\t%d\n"
+            "bnez\t$a0,\t_write_newline_room\n"
+            "addi\t$sp,\t$sp,\t-4\n"
+            "sw\t$ra,\t4($sp)\n"
+            "jal\t%s\n"
+            "lw\t$ra,\t4($sp)\n"
+            "addi\t$sp,\t$sp,\t4\n"
+            "li\t$v0,\t0\n"
+            "_write_newline_room:\n"
+            "la\t$a0,\t_out_buf\n"
+            "add\t$a0,\t$a0,\t$v0\n"
+            "addi\t$v0,\t$v0,\t1\n"
+            "sw\t$v0,\t_out_pos\n"
+            "li\t$v0,\t10\n"
+            "sb\t$v0,\t0($a0)\n"
+            "jr\t$ra\n",
+            RUNTIME_WRITELN, OUT_BUFFER_SIZE - 1, RUNTIME_FLUSH);
+    fprintf(out, "\n%s:\n"
+            "lw\t$v0,\t_out_pos\n"
+            "beqz\t$v0,\t_out_flush_done\n"
+            "la\t$a0,\t_out_buf\n"
+            "add\t$a0,\t$a0,\t$v0\n"
+            "sb\t$zero,\t0($a0)\n"
+            "sw\t$zero,\t_out_pos\n"
+            "la\t$a0,\t_out_buf\n"
+            "li\t$v0,\t4\n"
+            "syscall\n"
+            "_out_flush_done:\n"
+            "jr\t$ra\n",
+            RUNTIME_FLUSH);
+}
+
+/**
+ * Prints the input runtime.  The unread input lies between the addresses
+ * _in_pos and _in_end, both 0 before the first read; _in_fill reads the
+ * next IN_BUFFER_SIZE bytes of standard input and leaves the new bounds in
+ * $a0 and $v0, equal at the end of the input.  _read_int reads one line
+ * the way syscall 5 does, which applies atol to it: it skips spaces and
+ * tabs (and \v, \f and \r), takes an optional sign and the digits, then
+ * consumes the rest of the line through its '\n'.  A line without digits,
+ * an empty one too, gives 0 and only that line is consumed, as is the
+ * end of the input.  Like atol, the value wraps modulo 2^32 instead of
+ * trapping, so it is accumulated with addu and negated with subu.
+ * _read_char returns the next byte, 0 at the end.
+ */
+static void print_input_runtime(FILE * out) {
+    fprintf(out, "\n_in_fill:\n"
+            "addi\t$sp,\t$sp,\t-12\n"
+            "sw\t$ra,\t4($sp)\n"
+            "sw\t$a1,\t8($sp)\n"
+            "sw\t$a2,\t12($sp)\n"
+            "jal\t%s\n"
+            "li\t$a0,\t0\n"
+            "la\t$a1,\t_in_buf\n"
+            "li\t$a2,\t%d\n"
+            "li\t$v0,\t14\n"
+            "syscall\n"
+            "bgez\t$v0,\t_in_fill_read\n"
+            "li\t$v0,\t0\n"
+            "_in_fill_read:\n"
+            "la\t$a0,\t_in_buf\n"
+            "add\t$v0,\t$a0,\t$v0\n"
+            "sw\t$a0,\t_in_pos\n"
+            "sw\t$v0,\t_in_end\n"
+            "lw\t$ra,\t4($sp)\n"
+            "lw\t$a1,\t8($sp)\n"
+            "lw\t$a2,\t12($sp)\n"
+            "addi\t$sp,\t$sp,\t12\n"
+            "jr\t$ra\n",
+            RUNTIME_FLUSH, IN_BUFFER_SIZE);
+    fprintf(out, "\n%s:\n"
+            "lw\t$a0,\t_in_pos\n"
+            "lw\t$v0,\t_in_end\n"
+            "bne\t$a0,\t$v0,\t_read_char_ready\n"
+            "addi\t$sp,\t$sp,\t-4\n"
+            "sw\t$ra,\t4($sp)\n"
+            "jal\t_in_fill\n"
+            "lw\t$ra,\t4($sp)\n"
+            "addi\t$sp,\t$sp,\t4\n"
+            "bne\t$a0,\t$v0,\t_read_char_ready\n"
+            "li\t$v0,\t0\n"
+            "jr\t$ra\n"
+            "_read_char_ready:\n"
+            "lbu\t$v0,\t0($a0)\n"
+            "addi\t$a0,\t$a0,\t1\n"
+            "sw\t$a0,\t_in_pos\n"
+            "jr\t$ra\n",
+            RUNTIME_READ_CHAR);
+    // $t0 the value, $t1 set for a minus sign, $t2 the current byte at $a0
+    fprintf(out, "\n%s:\n"
+            "addi\t$sp,\t$sp,\t-20\n"
+            "sw\t$ra,\t4($sp)\n"
+            "sw\t$t0,\t8($sp)\n"
+            "sw\t$t1,\t12($sp)\n"
+            "sw\t$t2,\t16($sp)\n"
+            "sw\t$t3,\t20($sp)\n"
+            "li\t$t0,\t0\n"
+            "li\t$t1,\t0\n"
+            "lw\t$a0,\t_in_pos\n"
+            "lw\t$v0,\t_in_end\n"
+            "_read_int_blank:\n"
+            "bne\t$a0,\t$v0,\t_read_int_blank_ready\n"
+            "jal\t_in_fill\n"
+            "beq\t$a0,\t$v0,\t_read_int_done\n"
+            "_read_int_blank_ready:\n"
+            "lbu\t$t2,\t0($a0)\n"
+            "addi\t$t3,\t$t2,\t-48\n"
+            "sltiu\t$t3,\t$t3,\t10\n"
+            "bnez\t$t3,\t_read_int_digit\n"
+            "li\t$t3,\t10\n"
+            "beq\t$t2,\t$t3,\t_read_int_newline\n"
+            "li\t$t3,\t32\n"
+            "beq\t$t2,\t$t3,\t_read_int_skip\n"
+            "addi\t$t3,\t$t2,\t-9\n"
+            "sltiu\t$t3,\t$t3,\t5\n"
+            "beqz\t$t3,\t_read_int_sign\n"
+            "_read_int_skip:\n"
+            "addi\t$a0,\t$a0,\t1\n"
+            "j\t_read_int_blank\n"
+            "_read_int_sign:\n"
+            "li\t$t3,\t43\n"
+            "beq\t$t2,\t$t3,\t_read_int_plus\n"
+            "li\t$t3,\t45\n"
+            "bne\t$t2,\t$t3,\t_read_int_rest\n"
+            "li\t$t1,\t1\n"
+            "_read_int_plus:\n"
+            "addi\t$a0,\t$a0,\t1\n"
+            "bne\t$a0,\t$v0,\t_read_int_sign_ready\n"
+            "jal\t_in_fill\n"
+            "beq\t$a0,\t$v0,\t_read_int_done\n"
+            "_read_int_sign_ready:\n"
+            "lbu\t$t2,\t0($a0)\n"
+            "addi\t$t3,\t$t2,\t-48\n"
+            "sltiu\t$t3,\t$t3,\t10\n"
+            "beqz\t$t3,\t_read_int_rest\n"
+            "_read_int_digit:\n"
+            "sll\t$t3,\t$t0,\t3\n"
+            "sll\t$t0,\t$t0,\t1\n"
+            "addu\t$t0,\t$t0,\t$t3\n"
+            "addi\t$t2,\t$t2,\t-48\n"
+            "addu\t$t0,\t$t0,\t$t2\n"
+            "addi\t$a0,\t$a0,\t1\n"
+            "bne\t$a0,\t$v0,\t_read_int_digit_ready\n"
+            "jal\t_in_fill\n"
+            "beq\t$a0,\t$v0,\t_read_int_done\n"
+            "_read_int_digit_ready:\n"
+            "lbu\t$t2,\t0($a0)\n"
+            "addi\t$t3,\t$t2,\t-48\n"
+            "sltiu\t$t3,\t$t3,\t10\n"
+            "bnez\t$t3,\t_read_int_digit\n"
+            "_read_int_rest:\n"
+            "li\t$t3,\t10\n"
+            "_read_int_line:\n"
+            "beq\t$t2,\t$t3,\t_read_int_newline\n"
+            "addi\t$a0,\t$a0,\t1\n"
+            "bne\t$a0,\t$v0,\t_read_int_line_ready\n"
+            "jal\t_in_fill\n"
+            "beq\t$a0,\t$v0,\t_read_int_done\n"
+            "_read_int_line_ready:\n"
+            "lbu\t$t2,\t0($a0)\n"
+            "j\t_read_int_line\n"
+            "_read_int_newline:\n"
+            "addi\t$a0,\t$a0,\t1\n"
+            "_read_int_done:\n"
+            "sw\t$a0,\t_in_pos\n"
+            "move\t$v0,\t$t0\n"
+            "beqz\t$t1,\t_read_int_return\n"
+            "subu\t$v0,\t$zero,\t$t0\n"
+            "_read_int_return:\n"
+            "lw\t$ra,\t4($sp)\n"
+            "lw\t$t0,\t8($sp)\n"
+            "lw\t$t1,\t12($sp)\n"
+            "lw\t$t2,\t16($sp)\n"
+            "lw\t$t3,\t20($sp)\n"
+            "addi\t$sp,\t$sp,\t20\n"
+            "jr\t$ra\n",
+            RUNTIME_READ_INT);
+}
+
 int codetable_print(FILE * out) {
+    int i;
+
     print_preamble(out);
+    for (i = 0; i < instruction_count; i++)
+        print_instruction(out, instructions[i]);
+    print_runtime(out);
+    if (buffered_input) print_input_runtime(out);
+    return 0;
+}
 
-    int i = 0;
-    Instruction_line * l;
+void print_instruction(FILE * out, Instruction_line * l) {
     char dollar = '$'; // no comment
-    for (i = 0; i < instruction_count; i++) {
-        dollar = '$';
-        l = instructions[i];
-
-        if (l->type == LABEL) {
-            if (l->label == FUNCTION)
-                fprintf(out, "%s:\n", l->label_name);
-            else
-                fprintf(out, "%s.%d:\n", label_string[l->label], l->label_sn);
-            continue;
-        } else if (l->type == TEXT) {
-            if (l->label == FUN_PREAMBLE)
-                fprintf(out, FUNCTION_BEGIN);
-            else if (l->label == FUN_EPILOG)
-                fprintf(out, FUNCTION_END);
-        } else if (l->type == BEQZ || l->type == BNEZ) {
-            fprintf(out, "%s\t$%d,\t%s.%d\n", instruction_type_string[l->type], l->dest_reg, label_string[l->label], l->label_sn);
-            continue;
-        } else if ((l->type == B_I) || (l->type == J_I)) {
-            fprintf(out, "%s\t%s.%d\n", instruction_type_string[l->type], label_string[l->label], l->label_sn);
-            continue;
-        } else if ((l->type == JAL)) {
-            fprintf(out, "%s\t%s\n", instruction_type_string[l->type], l->label_name);
-            continue;
-        } else if ((l->type == BGE) || (l->type == BLE)) {
-            fprintf(out, "%s\t$%d,\t$%d,\t%s.%d\n", instruction_type_string[l->type], l->dest_reg, l->reg1, label_string[l->label], l->label_sn);
-            continue;
-        } else {
-            fprintf(out, "%s", instruction_type_string[l->type]);
+
+    if (l->type == LABEL) {
+        if (l->label == FUNCTION)
+            fprintf(out, "%s:\n", l->label_name);
+        else
+            fprintf(out, "%s.%d:\n", label_string[l->label], l->label_sn);
+        return;
+    } else if (l->type == BEQZ || l->type == BNEZ || l->type == BLTZ || l->type == BGEZ
+            || l->type == BLEZ || l->type == BGTZ) {
+        fprintf(out, "%s\t$%d,\t%s.%d\n", instruction_type_string[l->type], l->dest_reg, label_string[l->label], l->label_sn);
+        return;
+    } else if ((l->type == B_I) || (l->type == J_I)) {
+        fprintf(out, "%s\t%s.%d\n", instruction_type_string[l->type], label_string[l->label], l->label_sn);
+        return;
+    } else if ((l->type == JAL)) {
+        fprintf(out, "%s\t%s\n", instruction_type_string[l->type], l->label_name);
+        return;
+    } else if ((l->type == BGE) || (l->type == BLE) || (l->type == BEQ) || (l->type == BNE)
+            || (l->type == BLT) || (l->type == BGT)) {
+        fprintf(out, "%s\t$%d,\t$%d,\t%s.%d\n", instruction_type_string[l->type], l->dest_reg, l->reg1, label_string[l->label], l->label_sn);
+        return;
+    } else {
+        fprintf(out, "%s", instruction_type_string[l->type]);
+    }
+
+    if (l->type == LA) {
+        fprintf(out, "\t$%d,\t%s", l->dest_reg, l->label_name ? l->label_name : "_newline_");
+    } else if (l->label_name != NULL) {
+        // small data, addressed from $gp by the assembler
+        if (l->offset != 0)
+            fprintf(out, "\t$%d,\t%s+%d", l->dest_reg, l->label_name, l->offset);
+        else
+            fprintf(out, "\t$%d,\t%s", l->dest_reg, l->label_name);
+    } else if (l->offset >= 0 || l->type == LW || l->type == LB || l->type == SW || l->type == SB) {
+        // a load or store always has an offset, which may be negative
+        switch (instruction_reg_count[l->type]) {
+            case 2:
+                fprintf(out, "\t$%d,\t%d($%d)", l->dest_reg, l->offset, l->reg1);
+                break;
+            case 3:
+                fprintf(out, "\t$%d,\t$%d,\t%d($%d)", l->dest_reg, l->reg1, l->offset, l->reg2);
+                break;
         }
 
-        if (l->type == LA) {
-            fprintf(out, "\t$%d,\t_newline_", l->dest_reg);
-        } else if (l->offset >= 0) {
-            switch (instruction_reg_count[l->type]) {
-                case 2:
-                    fprintf(out, "\t$%d,\t%d($%d)", l->dest_reg, l->offset, l->reg1);
-                    break;
-                case 3:
-                    fprintf(out, "\t$%d,\t$%d,\t%d($%d)", l->dest_reg, l->reg1, l->offset, l->reg2);
-                    break;
-            }
-
-        } else {
-            if ((l->type == LI) || (l->type == ADDI)) {
-                dollar = ' ';
-            }
-            switch (instruction_reg_count[l->type]) {
-                case 3:
-                    fprintf(out, "\t$%d,\t$%d,\t%c%d", l->dest_reg, l->reg1, dollar, l->reg2);
-                    break;
-                case 2:
-                    fprintf(out, "\t$%d,\t%c%d", l->dest_reg, dollar, l->reg1);
-                    break;
-                case 1:
-                    fprintf(out, "\t$%d", l->dest_reg);
-                    break;
-            }
+    } else {
+        if ((l->type == LI) || (l->type == ADDI) || (l->type == SLL) || (l->type == SRA) || (l->type == SRL)
+                || (l->type == SLTI) || (l->type == SLTIU) || (l->type == XORI)) {
+            dollar = ' ';
+        }
+        switch (instruction_reg_count[l->type]) {
+            case 3:
+                fprintf(out, "\t$%d,\t$%d,\t%c%d", l->dest_reg, l->reg1, dollar, l->reg2);
+                break;
+            case 2:
+                fprintf(out, "\t$%d,\t%c%d", l->dest_reg, dollar, l->reg1);
+                break;
+            case 1:
+                fprintf(out, "\t$%d", l->dest_reg);
+                break;
         }
-        fprintf(out, "\n");
     }
-    return 0;
+    fprintf(out, "\n");
 }
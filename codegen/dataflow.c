@@ -0,0 +1,179 @@
+// worklist solver for bit-vector dataflow problems
+
+#include <stdlib.h>
+#include "dataflow.h"
+
+static Bitset * new_sets(int count, int words) {
+    Bitset * sets = (Bitset *) malloc((count > 0 ? count : 1) * sizeof (Bitset));
+    int i;
+
+    for (i = 0; i < count; i++)
+        sets[i] = bitset_new(words);
+    return sets;
+}
+
+static void free_sets(Bitset * sets, int count) {
+    int i;
+
+    for (i = 0; i < count; i++)
+        bitset_free(sets[i]);
+    free(sets);
+}
+
+/**
+ * Fills order with the blocks in reverse post-order from the entry;
+ * unreachable blocks follow in program order.
+ */
+static void reverse_post_order(Dataflow * flow) {
+    int count = flow->block_count;
+    int * visited = (int *) calloc(count > 0 ? count : 1, sizeof (int));
+    int * stack = (int *) malloc((count > 0 ? count : 1) * sizeof (int));
+    int * edge = (int *) calloc(count > 0 ? count : 1, sizeof (int));
+    int top = 0, done = count;
+    int i;
+
+    // blocks are numbered into order from the back as they finish
+    if (count > 0) {
+        stack[top++] = 0;
+        visited[0] = 1;
+    }
+    while (top > 0) {
+        int b = stack[top - 1];
+        Cfg_block * block = get_cfg_block(flow->first_block + b);
+        if (edge[b] < block->succ_count) {
+            int s = block->succ[edge[b]++] - flow->first_block;
+            if (!visited[s]) {
+                visited[s] = 1;
+                stack[top++] = s;
+            }
+        } else {
+            flow->order[--done] = b;
+            top--;
+        }
+    }
+    // shift the reachable blocks down and append the rest
+    for (i = 0; i < count - done; i++)
+        flow->order[i] = flow->order[done + i];
+    done = count - done;
+    for (i = 0; i < count; i++)
+        if (!visited[i]) flow->order[done++] = i;
+
+    free(visited);
+    free(stack);
+    free(edge);
+}
+
+Dataflow * dataflow_new(int function, Dataflow_direction direction, Dataflow_meet meet, int bits) {
+    Cfg_function * fun = get_cfg_function(function);
+    Dataflow * flow = (Dataflow *) malloc(sizeof (Dataflow));
+    int i, count;
+
+    flow->direction = direction;
+    flow->meet = meet;
+    flow->bits = bits;
+    flow->words = bitset_words(bits);
+    flow->first_block = fun->entry;
+    flow->block_count = count = fun->block_count;
+    flow->gen = new_sets(count, flow->words);
+    flow->kill = new_sets(count, flow->words);
+    flow->in = new_sets(count, flow->words);
+    flow->out = new_sets(count, flow->words);
+    flow->boundary = bitset_new(flow->words);
+    flow->order = (int *) malloc((count > 0 ? count : 1) * sizeof (int));
+    flow->visits = 0;
+    reverse_post_order(flow);
+
+    // post-order serves backward problems
+    if (direction == DATAFLOW_BACKWARD) {
+        for (i = 0; i < count / 2; i++) {
+            int swap = flow->order[i];
+            flow->order[i] = flow->order[count - 1 - i];
+            flow->order[count - 1 - i] = swap;
+        }
+    }
+    return flow;
+}
+
+void dataflow_free(Dataflow * flow) {
+    if (flow == NULL) return;
+    free_sets(flow->gen, flow->block_count);
+    free_sets(flow->kill, flow->block_count);
+    free_sets(flow->in, flow->block_count);
+    free_sets(flow->out, flow->block_count);
+    bitset_free(flow->boundary);
+    free(flow->order);
+    free(flow);
+}
+
+/**
+ * Meets the given sets of the neighbours of a block into result.
+ */
+static void meet_neighbours(Dataflow * flow, int * neighbours, int count, Bitset * sets, Bitset result) {
+    int i;
+
+    if (count == 0) {
+        bitset_copy(result, flow->boundary, flow->words);
+        return;
+    }
+    bitset_copy(result, sets[neighbours[0] - flow->first_block], flow->words);
+    for (i = 1; i < count; i++) {
+        if (flow->meet == DATAFLOW_UNION)
+            bitset_union(result, sets[neighbours[i] - flow->first_block], flow->words);
+        else
+            bitset_intersect(result, sets[neighbours[i] - flow->first_block], flow->words);
+    }
+}
+
+void dataflow_solve(Dataflow * flow) {
+    int count = flow->block_count;
+    int forward = (flow->direction == DATAFLOW_FORWARD);
+    int pending_words = bitset_words(count);
+    Bitset pending = bitset_new(pending_words);
+    int * position = (int *) malloc((count > 0 ? count : 1) * sizeof (int));
+    int cursor = 0;
+    int i, p;
+
+    for (i = 0; i < count; i++) {
+        position[flow->order[i]] = i;
+        // must problems start from the top of the lattice
+        if (flow->meet == DATAFLOW_INTERSECTION) {
+            bitset_fill(forward ? flow->out[i] : flow->in[i], flow->bits);
+        }
+    }
+    bitset_fill(pending, count);
+    flow->visits = 0;
+
+    for (;;) {
+        Cfg_block * block;
+        int * dependents;
+        int dependent_count;
+        int changed, b;
+
+        p = bitset_next(pending, cursor, pending_words);
+        if (p < 0) p = bitset_next(pending, 0, pending_words);
+        if (p < 0) break;
+        bitset_clear(pending, p);
+        cursor = p + 1;
+        flow->visits++;
+
+        b = flow->order[p];
+        block = get_cfg_block(flow->first_block + b);
+        if (forward) {
+            meet_neighbours(flow, block->preds, block->pred_count, flow->out, flow->in[b]);
+            changed = bitset_transfer(flow->out[b], flow->gen[b], flow->in[b], flow->kill[b], flow->words);
+            dependents = block->succ;
+            dependent_count = block->succ_count;
+        } else {
+            meet_neighbours(flow, block->succ, block->succ_count, flow->in, flow->out[b]);
+            changed = bitset_transfer(flow->in[b], flow->gen[b], flow->out[b], flow->kill[b], flow->words);
+            dependents = block->preds;
+            dependent_count = block->pred_count;
+        }
+        if (!changed) continue;
+        for (i = 0; i < dependent_count; i++)
+            bitset_set(pending, position[dependents[i] - flow->first_block]);
+    }
+
+    bitset_free(pending);
+    free(position);
+}
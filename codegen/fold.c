@@ -0,0 +1,381 @@
+// constant folding and algebraic simplification of the annotated AST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "parser.h"
+#include "lexer.h"
+#include "semantic.h"
+#include "fold.h"
+
+static void fold_stmt(ast_node ** slot);
+
+static int is_num(ast_node * node) {
+    return node != NULL && node->symbol->token == NUM;
+}
+
+static void free_tree(ast_node * node) {
+    int i;
+
+    if (node == NULL) return;
+    for (i = 0; i < node->num_children; i++)
+        free_tree(node->childlist[i]);
+    free(node->childlist);
+    free(node->symbol);
+    free(node);
+}
+
+/**
+ * Turns node into the literal value, dropping its operands.
+ */
+static void make_num(ast_node * node, int value) {
+    int i;
+
+    for (i = 0; i < node->num_children; i++)
+        free_tree(node->childlist[i]);
+    node->num_children = 0;
+    node->symbol->token = NUM;
+    node->symbol->value = value;
+    node->symbol->sym = -1;
+    node->symbol->type = T_INT;
+    sprintf(node->symbol->lexeme, "%d", value);
+}
+
+/**
+ * Replaces node by its operand keep, dropping the other operands.
+ */
+static void replace_with_child(ast_node * node, int keep) {
+    ast_node * child = node->childlist[keep];
+    int i;
+
+    for (i = 0; i < node->num_children; i++)
+        if (i != keep) free_tree(node->childlist[i]);
+    free(node->childlist);
+    free(node->symbol);
+    *node = *child;
+    free(child);
+}
+
+static void swap_children(ast_node * node) {
+    ast_node * first = node->childlist[0];
+
+    node->childlist[0] = node->childlist[1];
+    node->childlist[1] = first;
+}
+
+/**
+ * @return: 1 if evaluating the expression changes nothing, it has no
+ *          assignment and no call
+ */
+static int is_pure(ast_node * node) {
+    int i;
+
+    if (node->symbol->token == ASSIGN || is_call_node(node)) return 0;
+    for (i = 0; i < node->num_children; i++)
+        if (!is_pure(node->childlist[i])) return 0;
+    return 1;
+}
+
+/**
+ * @return: 1 if both expressions are written the same way
+ */
+static int same_expr(ast_node * a, ast_node * b) {
+    int i;
+
+    if (a->symbol->token != b->symbol->token || a->num_children != b->num_children)
+        return 0;
+    if (a->symbol->token == NUM && a->symbol->value != b->symbol->value) return 0;
+    if (a->symbol->token == ID && a->symbol->sym != b->symbol->sym) return 0;
+    for (i = 0; i < a->num_children; i++)
+        if (!same_expr(a->childlist[i], b->childlist[i])) return 0;
+    return 1;
+}
+
+/**
+ * Computes x op y as the generated code would, in 32 bits.
+ * @return: 0 if the operation cannot be done at compile time
+ */
+static int evaluate(int op, int x, int y, int * value) {
+    unsigned int ux = (unsigned int) x, uy = (unsigned int) y;
+
+    switch (op) {
+        case PLUS: *value = (int) (ux + uy); return 1;
+        case MINUS: *value = (int) (ux - uy); return 1;
+        case MULT: *value = (int) (ux * uy); return 1;
+        case DIV:
+            // division by zero is left for the program to do
+            if (y == 0 || (x == INT_MIN && y == -1)) return 0;
+            *value = x / y;
+            return 1;
+        case AND: *value = x != 0 && y != 0; return 1;
+        case OR: *value = x != 0 || y != 0; return 1;
+        case LSS: *value = x < y; return 1;
+        case LEQ: *value = x <= y; return 1;
+        case GTR: *value = x > y; return 1;
+        case GEQ: *value = x >= y; return 1;
+        case EQU: *value = x == y; return 1;
+        case NEQ: *value = x != y; return 1;
+    }
+    return 0;
+}
+
+static int is_additive(ast_node * node) {
+    return (node->symbol->token == PLUS || node->symbol->token == MINUS)
+        && node->num_children == 2;
+}
+
+/**
+ * node is a + c or a - c with a literal c: folds a constant added or
+ * subtracted at the end of a too, then writes the sum as x + c or x - c,
+ * or just x when the constants cancel.  The constants are merged only
+ * when their sum fits an int, so the new sum overflows only for operands
+ * the original one already overflowed for: (x + 2147483647) + 2 stays.
+ */
+static void fold_additive(ast_node * node) {
+    ast_node * left = node->childlist[0];
+    ast_node * right = node->childlist[1];
+    long long sum = right->symbol->value;
+
+    if (node->symbol->token == MINUS) sum = -sum;
+    if (is_additive(left) && is_num(left->childlist[1])) {
+        long long inner = left->childlist[1]->symbol->value;
+        long long merged = sum + (left->symbol->token == PLUS ? inner : -inner);
+
+        if (merged >= INT_MIN && merged <= INT_MAX) {
+            sum = merged;
+            node->childlist[0] = left->childlist[0];
+            free_tree(left->childlist[1]);
+            free(left->childlist);
+            free(left->symbol);
+            free(left);
+        }
+    }
+    if (sum == 0) {
+        replace_with_child(node, 0);
+        return;
+    }
+    // x - (-2147483648) has no x + c form
+    if (sum > INT_MAX) return;
+    if (sum < 0 && sum != INT_MIN) {
+        node->symbol->token = MINUS;
+        sum = -sum;
+    } else {
+        node->symbol->token = PLUS;
+    }
+    right->symbol->value = (int) sum;
+    sprintf(right->symbol->lexeme, "%d", right->symbol->value);
+}
+
+/**
+ * a && k or a || k with a literal k, either way round: k decides the
+ * value when it is 0 for && or not 0 for ||, if a can be dropped.  a
+ * literal on the left always can, a is never evaluated then.
+ */
+static void fold_logical(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int literal = is_num(args[0]) ? 0 : 1;
+    int k = args[literal]->symbol->value;
+
+    if ((node->symbol->token == AND ? k == 0 : k != 0) && (literal == 0 || is_pure(args[0])))
+        make_num(node, node->symbol->token == OR);
+}
+
+static void fold_binary(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int op = node->symbol->token;
+    int value;
+
+    if (is_num(args[0]) && is_num(args[1])) {
+        if (evaluate(op, args[0]->symbol->value, args[1]->symbol->value, &value))
+            make_num(node, value);
+        return;
+    }
+    // the literal operand of + and * goes on the right
+    if (is_num(args[0]) && (op == PLUS || op == MULT)) swap_children(node);
+    switch (op) {
+        case PLUS:
+        case MINUS:
+            if (is_num(args[1]))
+                fold_additive(node);
+            else if (op == MINUS && same_expr(args[0], args[1]) && is_pure(args[0]))
+                make_num(node, 0);
+            return;
+        case MULT:
+            if (!is_num(args[1])) return;
+            if (args[0]->symbol->token == MULT && get_num_children(args[0]) == 2
+                && is_num(get_childlist(args[0])[1])) {
+                ast_node * left = args[0];
+                evaluate(MULT, args[1]->symbol->value, get_childlist(left)[1]->symbol->value, &value);
+                make_num(args[1], value);
+                args[0] = get_childlist(left)[0];
+                free_tree(get_childlist(left)[1]);
+                free(left->childlist);
+                free(left->symbol);
+                free(left);
+            }
+            if (args[1]->symbol->value == 1)
+                replace_with_child(node, 0);
+            else if (args[1]->symbol->value == 0 && is_pure(args[0]))
+                make_num(node, 0);
+            return;
+        case DIV:
+            if (is_num(args[1]) && args[1]->symbol->value == 1) replace_with_child(node, 0);
+            return;
+        case AND:
+        case OR:
+            if (is_num(args[0]) || is_num(args[1])) fold_logical(node);
+            return;
+    }
+}
+
+/**
+ * Folds the operands of an expression, then the expression itself.  The
+ * parser leaves out an operand it could not parse, and an operator that
+ * lacks one is left as it is.
+ */
+static void fold_expr(ast_node * node) {
+    ast_node ** args;
+    int i, num_args;
+
+    if (node == NULL) return;
+    args = get_childlist(node);
+    num_args = get_num_children(node);
+    for (i = 0; i < num_args; i++)
+        fold_expr(args[i]);
+    switch (node->symbol->token) {
+        case MINUS:
+            if (num_args == 2) {
+                fold_binary(node);
+            } else if (num_args != 1) {
+                return;
+            } else if (is_num(args[0])) {
+                make_num(node, (int) (0u - (unsigned int) args[0]->symbol->value));
+            } else if (args[0]->symbol->token == MINUS && get_num_children(args[0]) == 1) {
+                replace_with_child(node, 0);
+                replace_with_child(node, 0);
+            }
+            return;
+        case NEG:
+            if (num_args == 1 && is_num(args[0])) make_num(node, args[0]->symbol->value == 0);
+            return;
+        case PLUS:
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case LSS:
+        case LEQ:
+        case GTR:
+        case GEQ:
+        case EQU:
+        case NEQ:
+            if (num_args == 2) fold_binary(node);
+            return;
+    }
+}
+
+/**
+ * @return: a block with no declarations and no statements
+ */
+static ast_node * empty_block(int line_no) {
+    ast_node * block = create_ast_node(create_new_ast_node_info(NONTERMINAL, 0, BLOCK_N, "", line_no));
+
+    add_child_node(block, create_ast_node(create_new_ast_node_info(NONTERMINAL, 0, VAR_DECL_LIST, "", line_no)));
+    add_child_node(block, create_ast_node(create_new_ast_node_info(NONTERMINAL, 0, STMT_LIST, "", line_no)));
+    return block;
+}
+
+/**
+ * Folds a statement that must stay one, the arm of an if or the body of a
+ * while: one that goes away is replaced by an empty block.
+ */
+static void fold_arm(ast_node ** slot) {
+    int line_no = (*slot)->symbol->line_no;
+
+    fold_stmt(slot);
+    if (*slot == NULL) *slot = empty_block(line_no);
+}
+
+static void fold_stmt_list(ast_node * node) {
+    ast_node ** statements = get_childlist(node);
+    int i, kept = 0;
+
+    for (i = 0; i < get_num_children(node); i++) {
+        fold_stmt(&statements[i]);
+        if (statements[i] != NULL) statements[kept++] = statements[i];
+    }
+    node->num_children = kept;
+}
+
+/**
+ * An if with a constant condition becomes the arm that runs.
+ */
+static void fold_if(ast_node ** slot) {
+    ast_node * node = *slot;
+    ast_node ** args = get_childlist(node);
+    int num_args = get_num_children(node);
+    ast_node * else_node;
+    ast_node ** taken = NULL;
+
+    if (num_args < 2) return;
+    else_node = args[num_args - 1];
+    fold_expr(args[0]);
+    if (num_args == 3) fold_arm(&args[1]);
+    if (get_num_children(else_node) > 0) fold_arm(&get_childlist(else_node)[0]);
+    if (!is_num(args[0])) return;
+
+    if (args[0]->symbol->value != 0) {
+        if (num_args == 3) taken = &args[1];
+    } else if (get_num_children(else_node) > 0) {
+        taken = &get_childlist(else_node)[0];
+    }
+    *slot = taken != NULL ? *taken : NULL;
+    if (taken != NULL) *taken = NULL;
+    free_tree(node);
+}
+
+/**
+ * Folds a statement; *slot becomes NULL when nothing of it is left.  A
+ * statement that lost its expression to a syntax error is left as it is.
+ */
+static void fold_stmt(ast_node ** slot) {
+    ast_node * node = *slot;
+    ast_node ** args = get_childlist(node);
+
+    if (node->symbol->token == NONTERMINAL) {
+        if (node->symbol->grammar_symbol == BLOCK_N && get_num_children(node) == 2)
+            fold_stmt_list(args[1]);
+        return;
+    }
+    switch (node->symbol->token) {
+        case IF:
+            fold_if(slot);
+            return;
+        case WHILE:
+            if (get_num_children(node) == 0) return;
+            fold_expr(args[0]);
+            if (get_num_children(node) > 1) fold_arm(&args[1]);
+            // a loop that never runs
+            if (is_num(args[0]) && args[0]->symbol->value == 0) {
+                free_tree(node);
+                *slot = NULL;
+            }
+            return;
+        case RETURN:
+        case WRITE:
+            if (get_num_children(node) > 0) fold_expr(args[0]);
+            return;
+        case READ:
+        case BREAK:
+        case WRITELN:
+            return;
+    }
+    fold_expr(node); // an expression statement
+}
+
+void fold_constants() {
+    int i;
+
+    for (i = 0; i < get_function_count(); i++)
+        fold_stmt(&get_childlist(get_function(i)->node)[3]);
+}
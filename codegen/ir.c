@@ -0,0 +1,310 @@
+// three-address IR: construction helpers, CFG queries and a printer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ir.h"
+
+static Ir_function * ir_functions = NULL;
+static int ir_function_count = 0;
+static int ir_function_max = 0;
+
+static const char * ir_op_string[] = {
+    "nop",
+    "li",
+    "move",
+    "add",
+    "sub",
+    "addu",
+    "subu",
+    "mul",
+    "div",
+    "sll",
+    "sra",
+    "srl",
+    "addi",
+    "slti",
+    "xori",
+    "mulhi",
+    "slt",
+    "sle",
+    "sgt",
+    "sge",
+    "seq",
+    "sne",
+    "neg",
+    "not",
+    "addr",
+    "load",
+    "store",
+    "param",
+    "call",
+    "read",
+    "write",
+    "writeln",
+    "jump",
+    "branch",
+    "ret"
+};
+
+void ir_init() {
+    ir_destroy();
+}
+
+void ir_destroy() {
+    int i, j, k;
+
+    for (i = 0; i < ir_function_count; i++) {
+        Ir_function * f = &ir_functions[i];
+        for (j = 0; j < f->block_count; j++) {
+            for (k = 0; k < f->blocks[j].count; k++)
+                free(f->blocks[j].insts[k].args);
+            free(f->blocks[j].insts);
+        }
+        free(f->blocks);
+    }
+    free(ir_functions);
+    ir_functions = NULL;
+    ir_function_count = ir_function_max = 0;
+}
+
+Ir_function * ir_add_function(int fun) {
+    Ir_function * f;
+
+    if (ir_function_count >= ir_function_max) {
+        ir_function_max = ir_function_max > 0 ? ir_function_max * 2 : 16;
+        ir_functions = (Ir_function *) realloc(ir_functions, ir_function_max * sizeof (Ir_function));
+    }
+    f = &ir_functions[ir_function_count++];
+    f->fun = fun;
+    f->blocks = NULL;
+    f->block_count = 0;
+    f->block_max = 0;
+    f->vreg_count = 0;
+    return f;
+}
+
+/**
+ * @return: index of the new, empty block
+ */
+int ir_new_block(Ir_function * f, int loop_depth) {
+    Ir_block * block;
+
+    if (f->block_count >= f->block_max) {
+        f->block_max = f->block_max > 0 ? f->block_max * 2 : 16;
+        f->blocks = (Ir_block *) realloc(f->blocks, f->block_max * sizeof (Ir_block));
+    }
+    block = &f->blocks[f->block_count];
+    block->insts = NULL;
+    block->count = 0;
+    block->max = 0;
+    block->loop_depth = loop_depth;
+    return f->block_count++;
+}
+
+int ir_new_vreg(Ir_function * f) {
+    return f->vreg_count++;
+}
+
+/**
+ * Appends an instruction with no operands to a block.
+ * @return: the new instruction; valid until the block grows again
+ */
+Ir_inst * ir_append(Ir_function * f, int block, Ir_op op) {
+    Ir_block * b = &f->blocks[block];
+    Ir_inst * inst;
+
+    if (b->count >= b->max) {
+        b->max = b->max > 0 ? b->max * 2 : 8;
+        b->insts = (Ir_inst *) realloc(b->insts, b->max * sizeof (Ir_inst));
+    }
+    inst = &b->insts[b->count++];
+    inst->op = op;
+    inst->type = T_INT;
+    inst->dst = inst->a = inst->b = -1;
+    inst->imm = 0;
+    inst->sym = -1;
+    inst->args = NULL;
+    inst->arg_count = 0;
+    inst->target[0] = inst->target[1] = -1;
+    inst->compare = IR_NOP;
+    return inst;
+}
+
+int ir_is_terminator(Ir_op op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RET;
+}
+
+int ir_block_terminated(Ir_function * f, int block) {
+    Ir_block * b = &f->blocks[block];
+    return b->count > 0 && ir_is_terminator(b->insts[b->count - 1].op);
+}
+
+int ir_successors(Ir_function * f, int block, int succ[2]) {
+    Ir_block * b = &f->blocks[block];
+    Ir_inst * last;
+
+    if (b->count == 0) return 0;
+    last = &b->insts[b->count - 1];
+    switch (last->op) {
+        case IR_JUMP:
+            succ[0] = last->target[0];
+            return 1;
+        case IR_BRANCH:
+            succ[0] = last->target[0];
+            succ[1] = last->target[1];
+            return (succ[0] == succ[1]) ? 1 : 2;
+        default:
+            return 0;
+    }
+}
+
+Ir_op ir_negated(Ir_op op) {
+    switch (op) {
+        case IR_SLT: return IR_SGE;
+        case IR_SGE: return IR_SLT;
+        case IR_SLE: return IR_SGT;
+        case IR_SGT: return IR_SLE;
+        case IR_SEQ: return IR_SNE;
+        case IR_SNE: return IR_SEQ;
+        default: return op;
+    }
+}
+
+Ir_op ir_swapped(Ir_op op) {
+    switch (op) {
+        case IR_SLT: return IR_SGT;
+        case IR_SGT: return IR_SLT;
+        case IR_SLE: return IR_SGE;
+        case IR_SGE: return IR_SLE;
+        default: return op;
+    }
+}
+
+static void mark_reachable(Ir_function * f, int block, int * reachable) {
+    int succ[2];
+    int i, n;
+
+    if (reachable[block]) return;
+    reachable[block] = 1;
+    n = ir_successors(f, block, succ);
+    for (i = 0; i < n; i++)
+        mark_reachable(f, succ[i], reachable);
+}
+
+void ir_remove_unreachable(Ir_function * f) {
+    int * reachable = (int *) calloc(f->block_count, sizeof (int));
+    int * renumber = (int *) malloc(f->block_count * sizeof (int));
+    int i, j, count = 0;
+
+    if (f->block_count > 0) mark_reachable(f, 0, reachable);
+    for (i = 0; i < f->block_count; i++) {
+        if (reachable[i]) {
+            renumber[i] = count;
+            f->blocks[count++] = f->blocks[i];
+        } else {
+            for (j = 0; j < f->blocks[i].count; j++)
+                free(f->blocks[i].insts[j].args);
+            free(f->blocks[i].insts);
+            renumber[i] = -1;
+        }
+    }
+    f->block_count = count;
+    for (i = 0; i < count; i++) {
+        Ir_block * b = &f->blocks[i];
+        if (b->count == 0) continue;
+        for (j = 0; j < 2; j++)
+            if (b->insts[b->count - 1].target[j] >= 0)
+                b->insts[b->count - 1].target[j] = renumber[b->insts[b->count - 1].target[j]];
+    }
+    free(reachable);
+    free(renumber);
+}
+
+int get_ir_function_count() {
+    return ir_function_count;
+}
+
+Ir_function * get_ir_function(int index) {
+    return &ir_functions[index];
+}
+
+static void dump_memory_operand(FILE * out, Ir_inst * inst) {
+    if (inst->sym >= 0)
+        fprintf(out, "[%s", get_symbol(inst->sym)->name);
+    else
+        fprintf(out, "[v%d", inst->b);
+    if (inst->imm != 0) fprintf(out, "%+d", inst->imm);
+    fprintf(out, "]");
+}
+
+static void dump_inst(FILE * out, Ir_inst * inst) {
+    int i;
+
+    fprintf(out, "    ");
+    if (inst->dst >= 0) fprintf(out, "v%d = ", inst->dst);
+    fprintf(out, "%s", ir_op_string[inst->op]);
+    if (inst->op == IR_LOAD || inst->op == IR_STORE || inst->op == IR_READ)
+        fprintf(out, ".%s", inst->type == T_CHAR ? "c" : "i");
+
+    switch (inst->op) {
+        case IR_LI:
+        case IR_PARAM:
+            fprintf(out, " %d", inst->imm);
+            break;
+        case IR_SLL:
+        case IR_SRA:
+        case IR_SRL:
+        case IR_ADDI:
+        case IR_SLTI:
+        case IR_XORI:
+            fprintf(out, " v%d, %d", inst->a, inst->imm);
+            break;
+        case IR_ADDR:
+        case IR_LOAD:
+            fprintf(out, " ");
+            dump_memory_operand(out, inst);
+            break;
+        case IR_STORE:
+            fprintf(out, " v%d, ", inst->a);
+            dump_memory_operand(out, inst);
+            break;
+        case IR_CALL:
+            fprintf(out, " %s(", get_function(inst->sym)->name);
+            for (i = 0; i < inst->arg_count; i++)
+                fprintf(out, "%sv%d", i > 0 ? ", " : "", inst->args[i]);
+            fprintf(out, ")");
+            break;
+        case IR_JUMP:
+            fprintf(out, " B%d", inst->target[0]);
+            break;
+        case IR_BRANCH:
+            if (inst->compare != IR_NOP)
+                fprintf(out, ".%s v%d, v%d,", ir_op_string[inst->compare], inst->a, inst->b);
+            else
+                fprintf(out, " v%d,", inst->a);
+            fprintf(out, " B%d, B%d", inst->target[0], inst->target[1]);
+            break;
+        default:
+            if (inst->a >= 0) fprintf(out, " v%d", inst->a);
+            if (inst->b >= 0) fprintf(out, ", v%d", inst->b);
+            break;
+    }
+    fprintf(out, "\n");
+}
+
+void ir_dump(FILE * out) {
+    int i, j, k;
+
+    for (i = 0; i < ir_function_count; i++) {
+        Ir_function * f = &ir_functions[i];
+        fprintf(out, "function %s (%d vregs)\n", get_function(f->fun)->name, f->vreg_count);
+        for (j = 0; j < f->block_count; j++) {
+            fprintf(out, "B%d:", j);
+            if (f->blocks[j].loop_depth > 0) fprintf(out, "    ; loop depth %d", f->blocks[j].loop_depth);
+            fprintf(out, "\n");
+            for (k = 0; k < f->blocks[j].count; k++)
+                dump_inst(out, &f->blocks[j].insts[k]);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,660 @@
+// lowering of the annotated AST into the three-address IR
+//
+// expressions are lowered left to right into fresh virtual registers;
+// statements append to the current block and open new blocks at control
+// flow.  every block that falls off the end of the function returns.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "parser.h"
+#include "lexer.h"
+#include "ir.h"
+#include "codetable.h"
+#include "strength.h"
+
+static Ir_function * current = NULL;
+static int current_block = -1;
+static int loop_depth = 0;
+
+// jumps of the breaks out of the enclosing while loops, a list of
+// targets as below for each loop, innermost last
+static int * break_lists = NULL;
+static int break_count = 0;
+static int break_max = 0;
+
+static int lower_expr(ast_node * node);
+static int lower_logical(ast_node * node);
+static void lower_stmt(ast_node * node);
+
+static Ir_inst * emit(Ir_op op) {
+    return ir_append(current, current_block, op);
+}
+
+static int emit_binary(Ir_op op, int a, int b) {
+    Ir_inst * inst = emit(op);
+    inst->dst = ir_new_vreg(current);
+    inst->a = a;
+    inst->b = b;
+    return inst->dst;
+}
+
+static int emit_li(int value) {
+    Ir_inst * inst = emit(IR_LI);
+    inst->dst = ir_new_vreg(current);
+    inst->imm = value;
+    return inst->dst;
+}
+
+static int emit_immediate(Ir_op op, int a, int imm) {
+    Ir_inst * inst = emit(op);
+    inst->dst = ir_new_vreg(current);
+    inst->a = a;
+    inst->imm = imm;
+    return inst->dst;
+}
+
+static void emit_jump(int target) {
+    emit(IR_JUMP)->target[0] = target;
+}
+
+// a condition leaves lists of the jump and branch targets still to be
+// filled in, chained through the targets themselves: an entry is
+// block * 2 + k for target[k] of the terminator of block, which holds the
+// next entry until patch() sets it, and -1 is the empty list
+
+static int * target_of(int entry) {
+    Ir_block * block = &current->blocks[entry / 2];
+    return &block->insts[block->count - 1].target[entry % 2];
+}
+
+/**
+ * @return: the list of the entries of both lists
+ */
+static int merge(int list, int other) {
+    int entry = list;
+
+    if (list < 0) return other;
+    while (*target_of(entry) >= 0)
+        entry = *target_of(entry);
+    *target_of(entry) = other;
+    return list;
+}
+
+/**
+ * Sets every target on the list to block.
+ */
+static void patch(int list, int block) {
+    while (list >= 0) {
+        int * target = target_of(list);
+        list = *target;
+        *target = block;
+    }
+}
+
+/**
+ * Ends the current block with a jump whose target goes on *list.
+ */
+static void emit_open_jump(int * list) {
+    emit(IR_JUMP)->target[0] = *list;
+    *list = current_block * 2;
+}
+
+/**
+ * Ends the current block with a branch on a compare b, or on a != 0 if
+ * compare is IR_NOP, whose targets go on *if_true and *if_false.
+ */
+static void emit_branch(Ir_op compare, int a, int b, int * if_true, int * if_false) {
+    Ir_inst * inst = emit(IR_BRANCH);
+    inst->compare = compare;
+    inst->a = a;
+    inst->b = b;
+    inst->target[0] = *if_true;
+    inst->target[1] = *if_false;
+    *if_true = current_block * 2;
+    *if_false = current_block * 2 + 1;
+}
+
+/**
+ * Continues lowering in a fresh block, used after a terminator.
+ */
+static void start_block(int block) {
+    current_block = block;
+}
+
+static int is_array_name(ast_node * node) {
+    return node->symbol->token == ID && get_num_children(node) == 0
+        && get_symbol(node->symbol->sym)->kind == SYM_ARRAY;
+}
+
+/**
+ * @return: register holding the address of element 0 of an array
+ */
+static int lower_array_base(int sym) {
+    Ir_inst * inst;
+
+    if (get_symbol(sym)->storage == STORAGE_PARAM) {
+        // array parameters hold the address passed by the caller
+        inst = emit(IR_LOAD);
+        inst->type = T_INT;
+    } else {
+        inst = emit(IR_ADDR);
+    }
+    inst->dst = ir_new_vreg(current);
+    inst->sym = sym;
+    return inst->dst;
+}
+
+/**
+ * Lowers the address of an indexed array element into the memory operand
+ * of a load or store.  A constant added to the index goes in the offset,
+ * and so does a constant index, which needs no register at all unless the
+ * array is a parameter holding the address of its element 0.
+ */
+static void lower_element(ast_node * node, int * sym, int * base, int * offset) {
+    Symbol * symbol = get_symbol(node->symbol->sym);
+    ast_node * index_node = get_childlist(node)[0];
+    int size = (symbol->type == T_INT) ? 4 : 1;
+    int index;
+
+    *sym = *base = -1;
+    *offset = 0;
+    if (index_node->symbol->token == NUM && is_immediate((long long) index_node->symbol->value * size)) {
+        *offset = index_node->symbol->value * size;
+        if (symbol->storage == STORAGE_PARAM)
+            *base = lower_array_base(node->symbol->sym);
+        else
+            *sym = node->symbol->sym;
+        return;
+    }
+    // folding leaves i + c or i - c with the literal on the right
+    if ((index_node->symbol->token == PLUS || index_node->symbol->token == MINUS)
+            && get_num_children(index_node) == 2 && get_childlist(index_node)[1]->symbol->token == NUM) {
+        long long shift = (long long) get_childlist(index_node)[1]->symbol->value * size;
+        if (index_node->symbol->token == MINUS) shift = -shift;
+        if (is_immediate(shift)) {
+            *offset = (int) shift;
+            index_node = get_childlist(index_node)[0];
+        }
+    }
+    index = lower_expr(index_node);
+    if (size == 4) index = emit_immediate(IR_SLL, index, 2);
+    *base = emit_binary(IR_ADD, lower_array_base(node->symbol->sym), index);
+}
+
+static int lower_call(ast_node * node) {
+    ast_node * expr_list = get_childlist(node)[0];
+    ast_node ** args = get_childlist(expr_list);
+    int num_args = get_num_children(expr_list);
+    int * regs = (int *) malloc((num_args > 0 ? num_args : 1) * sizeof (int));
+    Ir_inst * inst;
+    int i;
+
+    for (i = 0; i < num_args; i++) {
+        if (is_array_name(args[i]))
+            regs[i] = lower_array_base(args[i]->symbol->sym);
+        else
+            regs[i] = lower_expr(args[i]);
+    }
+    inst = emit(IR_CALL);
+    inst->dst = ir_new_vreg(current);
+    inst->sym = get_symbol(node->symbol->sym)->function;
+    inst->type = get_function(inst->sym)->type;
+    inst->args = regs;
+    inst->arg_count = num_args;
+    return inst->dst;
+}
+
+static int lower_id(ast_node * node) {
+    Ir_inst * inst;
+    int sym, base, offset;
+
+    if (is_call_node(node))
+        return lower_call(node);
+    if (get_num_children(node) == 0) {
+        inst = emit(IR_LOAD);
+        inst->sym = node->symbol->sym;
+    } else {
+        lower_element(node, &sym, &base, &offset);
+        inst = emit(IR_LOAD);
+        inst->sym = sym;
+        inst->b = base;
+        inst->imm = offset;
+    }
+    inst->type = get_symbol(node->symbol->sym)->type;
+    inst->dst = ir_new_vreg(current);
+    return inst->dst;
+}
+
+static int lower_assign(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int value = lower_expr(args[1]);
+    Ir_inst * inst;
+    int sym, base, offset;
+
+    if (get_num_children(args[0]) == 0) {
+        inst = emit(IR_STORE);
+        inst->sym = args[0]->symbol->sym;
+    } else {
+        lower_element(args[0], &sym, &base, &offset);
+        inst = emit(IR_STORE);
+        inst->sym = sym;
+        inst->b = base;
+        inst->imm = offset;
+    }
+    inst->type = get_symbol(args[0]->symbol->sym)->type;
+    inst->a = value;
+    return value;
+}
+
+static Ir_op binary_op(int token) {
+    switch (token) {
+        case PLUS: return IR_ADD;
+        case MINUS: return IR_SUB;
+        case MULT: return IR_MUL;
+        case DIV: return IR_DIV;
+        case LSS: return IR_SLT;
+        case LEQ: return IR_SLE;
+        case GTR: return IR_SGT;
+        case GEQ: return IR_SGE;
+        case EQU: return IR_SEQ;
+        case NEQ: return IR_SNE;
+    }
+    return IR_NOP;
+}
+
+/**
+ * Emits a plan from strength.h on the value of x.
+ * @return: register holding the result
+ */
+static int lower_steps(int x, const Step * steps, int count) {
+    int acc = x;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        switch (steps[i].op) {
+            case STEP_SLL:
+                acc = emit_immediate(IR_SLL, acc, steps[i].imm);
+                break;
+            case STEP_SRA:
+                acc = emit_immediate(IR_SRA, acc, steps[i].imm);
+                break;
+            case STEP_SRL:
+                acc = emit_immediate(IR_SRL, acc, steps[i].imm);
+                break;
+            case STEP_ADD_X:
+                acc = emit_binary(IR_ADDU, acc, x);
+                break;
+            case STEP_SUB_X:
+                acc = emit_binary(IR_SUBU, acc, x);
+                break;
+            case STEP_NEG:
+                acc = emit_binary(IR_SUBU, emit_li(0), acc);
+                break;
+            case STEP_MULHI:
+                acc = emit_binary(IR_MULHI, acc, emit_li(steps[i].imm));
+                break;
+            case STEP_ADD_SIGN:
+                acc = emit_binary(IR_ADDU, acc, emit_immediate(IR_SRL, acc, 31));
+                break;
+        }
+    }
+    return acc;
+}
+
+/**
+ * @return: the comparison that holds when the operands are swapped
+ */
+static int mirrored(int token) {
+    switch (token) {
+        case LSS: return GTR;
+        case GTR: return LSS;
+        case LEQ: return GEQ;
+        case GEQ: return LEQ;
+    }
+    return token;
+}
+
+/**
+ * Lowers an operation with a literal operand c that fits an immediate:
+ * x + c and x - c (x + -c) become addi, x < c slti and x <= c is x < c + 1;
+ * x > c and x >= c are the negations of x < c + 1 and x < c, and x == c
+ * and x != c test x ^ c against 0, for c from 0 to 65535 that xori takes.
+ * A literal on the left of a comparison moves to the right, c < x being
+ * x > c.
+ * @return: register holding the value, -1 if the expression has no such form
+ */
+static int lower_immediate(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int token = node->symbol->token;
+    ast_node * x = args[0];
+    long long c;
+    int value;
+
+    if (get_num_children(node) != 2) return -1;
+    if (args[1]->symbol->token == NUM) {
+        c = args[1]->symbol->value;
+    } else if (args[0]->symbol->token == NUM && token != PLUS && token != MINUS) {
+        x = args[1];
+        c = args[0]->symbol->value;
+        token = mirrored(token);
+    } else {
+        return -1;
+    }
+    if (token == MINUS) c = -c;
+    if (token == LEQ || token == GTR) c++;
+    if (token == EQU || token == NEQ) {
+        if (c < 0 || c > LOGICAL_IMMEDIATE_MAX) return -1;
+    } else if (!is_immediate(c)) {
+        return -1;
+    }
+    switch (token) {
+        case PLUS:
+        case MINUS:
+            return emit_immediate(IR_ADDI, lower_expr(x), (int) c);
+        case LSS:
+        case LEQ:
+            return emit_immediate(IR_SLTI, lower_expr(x), (int) c);
+        case GTR:
+        case GEQ:
+            return emit_binary(IR_NOT, emit_immediate(IR_SLTI, lower_expr(x), (int) c), -1);
+        case EQU:
+        case NEQ:
+            // against 0 the li becomes $zero, no addi needed
+            if (c == 0) return -1;
+            // unlike x + -c, x ^ c cannot overflow
+            value = emit_immediate(IR_XORI, lower_expr(x), (int) c);
+            return emit_binary(token == EQU ? IR_SEQ : IR_SNE, value, emit_li(0));
+    }
+    return -1;
+}
+
+/**
+ * @return: register holding the value of the expression
+ */
+static int lower_expr(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    Step steps[MAX_STEPS];
+    int a, count;
+
+    switch (node->symbol->token) {
+        case NUM:
+            return emit_li(node->symbol->value);
+        case ID:
+            return lower_id(node);
+        case ASSIGN:
+            return lower_assign(node);
+        case NEG:
+            a = lower_expr(args[0]);
+            return emit_binary(IR_NOT, a, -1);
+        case AND:
+        case OR:
+            return lower_logical(node);
+        case MINUS:
+            if (get_num_children(node) == 1) {
+                a = lower_expr(args[0]);
+                return emit_binary(IR_NEG, a, -1);
+            }
+            if ((a = lower_immediate(node)) >= 0) return a;
+            break;
+        case PLUS:
+        case LSS:
+        case LEQ:
+        case GTR:
+        case GEQ:
+        case EQU:
+        case NEQ:
+            if ((a = lower_immediate(node)) >= 0) return a;
+            break;
+        case MULT:
+        case DIV:
+            // folding leaves a literal operand on the right
+            if (args[1]->symbol->token != NUM) break;
+            if (node->symbol->token == MULT)
+                count = plan_multiply(args[1]->symbol->value, steps);
+            else
+                count = plan_divide(args[1]->symbol->value, steps);
+            if (count >= 0) return lower_steps(lower_expr(args[0]), steps, count);
+            break;
+    }
+    a = lower_expr(args[0]);
+    return emit_binary(binary_op(node->symbol->token), a, lower_expr(args[1]));
+}
+
+static int is_comparison(int token) {
+    return token == LSS || token == LEQ || token == GTR || token == GEQ
+        || token == EQU || token == NEQ;
+}
+
+/**
+ * Lowers a condition into branches, leaving on *if_true the targets to
+ * take when it holds and on *if_false the others, so a comparison never
+ * becomes a 0 or 1 in a register: ! swaps the lists and a comparison
+ * branches on its operands, against $zero when one is the literal 0.
+ * x < c with any other literal c that fits an immediate is slti and a
+ * branch on its result, x <= c, x > c and x >= c being x < c + 1,
+ * !(x < c + 1) and !(x < c); == and != compare with an li.  a && b and
+ * a || b short-circuit: b is lowered in a block of its own that a
+ * branches to only when it does not decide the value.
+ */
+static void lower_cond(ast_node * node, int * if_true, int * if_false) {
+    ast_node ** args = get_childlist(node);
+    int token = node->symbol->token;
+    int left_true = -1, left_false = -1;
+    ast_node * x, * y;
+    long long c;
+    int a;
+
+    *if_true = *if_false = -1;
+    switch (token) {
+        case NUM:
+            emit_open_jump(node->symbol->value != 0 ? if_true : if_false);
+            return;
+        case NEG:
+            lower_cond(args[0], if_false, if_true);
+            return;
+        case AND:
+        case OR:
+            lower_cond(args[0], &left_true, &left_false);
+            start_block(ir_new_block(current, loop_depth));
+            patch(token == AND ? left_true : left_false, current_block);
+            lower_cond(args[1], if_true, if_false);
+            if (token == AND)
+                *if_false = merge(left_false, *if_false);
+            else
+                *if_true = merge(left_true, *if_true);
+            return;
+    }
+    if (!is_comparison(token)) {
+        emit_branch(IR_NOP, lower_expr(node), -1, if_true, if_false);
+        return;
+    }
+    x = args[0];
+    y = args[1];
+    if (x->symbol->token == NUM) {
+        x = args[1];
+        y = args[0];
+        token = mirrored(token);
+    }
+    if (y->symbol->token == NUM && y->symbol->value != 0 && token != EQU && token != NEQ) {
+        c = y->symbol->value;
+        if (token == LEQ || token == GTR) c++;
+        if (is_immediate(c)) {
+            a = emit_immediate(IR_SLTI, lower_expr(x), (int) c);
+            if (token == LSS || token == LEQ)
+                emit_branch(IR_NOP, a, -1, if_true, if_false);
+            else
+                emit_branch(IR_NOP, a, -1, if_false, if_true);
+            return;
+        }
+    }
+    a = lower_expr(x);
+    emit_branch(binary_op(token), a, lower_expr(y), if_true, if_false);
+}
+
+/**
+ * Lowers the value of a && b or a || b: 0, set to 1 in a block the
+ * condition branches to when it holds.
+ * @return: register holding the value
+ */
+static int lower_logical(ast_node * node) {
+    int value = emit_li(0);
+    int if_true, if_false, set_block, join_block;
+    Ir_inst * inst;
+
+    lower_cond(node, &if_true, &if_false);
+    set_block = ir_new_block(current, loop_depth);
+    join_block = ir_new_block(current, loop_depth);
+    patch(if_true, set_block);
+    patch(if_false, join_block);
+
+    start_block(set_block);
+    inst = emit(IR_LI);
+    inst->dst = value;
+    inst->imm = 1;
+    emit_jump(join_block);
+
+    start_block(join_block);
+    return value;
+}
+
+static void lower_if(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int num_args = get_num_children(node);
+    ast_node * else_node = args[num_args - 1];
+    int if_true, if_false, join = -1;
+
+    // blocks are created as they are reached, so they are laid out in
+    // the order of the source and each can fall through to the next
+    lower_cond(args[0], &if_true, &if_false);
+    start_block(ir_new_block(current, loop_depth));
+    patch(if_true, current_block);
+    if (num_args == 3) lower_stmt(args[1]);
+    emit_open_jump(&join);
+
+    start_block(ir_new_block(current, loop_depth));
+    patch(if_false, current_block);
+    if (get_num_children(else_node) > 0) lower_stmt(get_childlist(else_node)[0]);
+    emit_open_jump(&join);
+
+    start_block(ir_new_block(current, loop_depth));
+    patch(join, current_block);
+}
+
+static void lower_while(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int if_true, if_false, cond_block;
+
+    loop_depth++;
+    cond_block = ir_new_block(current, loop_depth);
+    emit_jump(cond_block);
+    start_block(cond_block);
+    lower_cond(args[0], &if_true, &if_false);
+
+    if (break_count >= break_max) {
+        break_max = break_max > 0 ? break_max * 2 : 8;
+        break_lists = (int *) realloc(break_lists, break_max * sizeof (int));
+    }
+    break_lists[break_count++] = if_false;
+
+    start_block(ir_new_block(current, loop_depth));
+    patch(if_true, current_block);
+    if (get_num_children(node) > 1) lower_stmt(args[1]);
+    emit_jump(cond_block);
+
+    // the exit block follows the body, it is the target of the breaks too
+    loop_depth--;
+    start_block(ir_new_block(current, loop_depth));
+    patch(break_lists[--break_count], current_block);
+}
+
+static void lower_stmt_list(ast_node * node) {
+    ast_node ** statements = get_childlist(node);
+    int i;
+
+    for (i = 0; i < get_num_children(node); i++)
+        lower_stmt(statements[i]);
+}
+
+static void lower_stmt(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    Ir_inst * inst;
+    int value;
+
+    if (node->symbol->token == NONTERMINAL) {
+        if (node->symbol->grammar_symbol == BLOCK_N)
+            lower_stmt_list(args[1]);
+        return;
+    }
+    switch (node->symbol->token) {
+        case IF:
+            lower_if(node);
+            return;
+        case WHILE:
+            lower_while(node);
+            return;
+        case BREAK:
+            if (break_count == 0) return;
+            emit_open_jump(&break_lists[break_count - 1]);
+            start_block(ir_new_block(current, loop_depth));
+            return;
+        case RETURN:
+            value = lower_expr(args[0]);
+            emit(IR_RET)->a = value;
+            start_block(ir_new_block(current, loop_depth));
+            return;
+        case READ:
+            inst = emit(IR_READ);
+            inst->type = get_symbol(args[0]->symbol->sym)->type;
+            inst->dst = value = ir_new_vreg(current);
+            inst = emit(IR_STORE);
+            inst->type = get_symbol(args[0]->symbol->sym)->type;
+            inst->sym = args[0]->symbol->sym;
+            inst->a = value;
+            return;
+        case WRITE:
+            value = lower_expr(args[0]);
+            emit(IR_WRITE)->a = value;
+            return;
+        case WRITELN:
+            emit(IR_WRITELN);
+            return;
+    }
+    lower_expr(node); // an expression statement
+}
+
+static void lower_function(int fun) {
+    FunDef * def = get_function(fun);
+    Ir_inst * inst;
+    int i, value;
+
+    current = ir_add_function(fun);
+    start_block(ir_new_block(current, 0));
+
+    // parameters passed in registers get copied to their frame slots
+    for (i = 0; i < def->param_count && i < 4; i++) {
+        inst = emit(IR_PARAM);
+        inst->dst = value = ir_new_vreg(current);
+        inst->imm = i;
+        inst = emit(IR_STORE);
+        inst->sym = def->params[i];
+        inst->type = get_symbol(def->params[i])->kind == SYM_ARRAY ? T_INT : get_symbol(def->params[i])->type;
+        inst->a = value;
+    }
+
+    lower_stmt(get_childlist(def->node)[3]);
+    if (!ir_block_terminated(current, current_block))
+        emit(IR_RET);
+
+    ir_remove_unreachable(current);
+}
+
+void ir_lower(ast_node * root) {
+    int i;
+
+    ir_init();
+    for (i = 0; i < get_function_count(); i++)
+        lower_function(i);
+    free(break_lists);
+    break_lists = NULL;
+    break_count = break_max = 0;
+}
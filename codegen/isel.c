@@ -0,0 +1,842 @@
+// instruction selection: IR to codetable
+//
+// every function gets one frame, allocated by its prologue, holding the
+// slots of all its parameters and locals and the spill slots of the
+// register allocator; nested blocks do not move $sp, and the locals of
+// blocks that are not nested in one another share slots.  a function that
+// calls nothing does not save $ra, and one that also needs no slot has
+// no frame at all.
+// like the direct AST emitter, slots are addressed from $sp one word
+// above it.  the scalar locals and parameters used most, weighted by
+// loop depth, live in $s0-$s7 instead of a slot; the registers taken are
+// saved below the spill slots on entry and restored on exit.  the other
+// parameters passed in registers become virtual registers.  virtual
+// registers get the physical registers chosen by regalloc.c, or $zero
+// when they only ever hold 0; spilled ones are reloaded into its scratch
+// registers at every use and stored back after every definition.  a call
+// saves the registers holding values live across it, if any, and stores
+// its stack arguments in the frame, so $sp only moves in the prologue and
+// epilogue.
+//
+// frame of a function, from $sp up after the prologue:
+//     4($sp) ...                    outgoing stack arguments of the largest call
+//     ...                           registers saved around a call
+//     ... frame($sp)                parameter, local and spill slots,
+//                                   then the saved $s registers
+//     frame+4($sp)                  $ra, unless the function is a leaf
+//     frame+8($sp) ...              stack arguments 4, 5, ... of the caller,
+//                                   from frame+4($sp) in a leaf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codegen.h"
+#include "codetable.h"
+#include "callgraph.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "stats.h"
+
+#define S_REGISTER_COUNT 8
+#define PROMOTE_MIN_WEIGHT 3    // weighted accesses that pay for a save and restore
+
+static int * slot_offset = NULL;        // frame offset of each Symbol
+static const char ** global_label = NULL;   // .data label of each global Symbol
+static int frame_size = 0;
+static int spill_base = 0;              // frame offset of spill slot 0
+static int s_save_base = 0;             // frame offset of the saved $s registers
+static int outgoing_size = 0;           // bytes of stack arguments of the largest call
+static int call_save_base = 0;          // frame offset of the area calls save registers in
+static int call_save_words = 0;         // most registers saved by one call
+static int save_ra = 0;                 // the function calls, so $ra is saved above the frame
+
+static Allocation alloc;
+static int * symbol_reg = NULL;         // $s register of each promoted Symbol, else -1
+static int promoted[S_REGISTER_COUNT];  // promoted Symbols, promoted[k] lives in $s<k>
+static int promoted_count = 0;
+static unsigned int * call_saves = NULL;    // registers each call saves, calls in block order
+static int call_index = 0;
+
+static int * block_label = NULL;
+static int exit_label = 0;
+
+static int get_slot_size(Symbol * symbol) {
+    int size = (symbol->type == T_INT) ? 4 : 1;
+
+    if (symbol->storage == STORAGE_PARAM && symbol->kind == SYM_ARRAY)
+        return 4;   // array parameters hold an address
+    size *= symbol->count;
+    if (symbol->storage == STORAGE_GLOBAL)
+        return (size + 3) / 4 * 4;
+    return size;
+}
+
+/**
+ * @return: the alignment a slot of the Symbol needs: 4 for words and
+ *          arrays of words, 1 for chars
+ */
+static int get_slot_align(Symbol * symbol) {
+    if (symbol->storage == STORAGE_PARAM && symbol->kind == SYM_ARRAY) return 4;
+    return (symbol->type == T_INT) ? 4 : 1;
+}
+
+static void allocate_globals() {
+    int i;
+
+    for (i = 0; i < get_symbol_count(); i++) {
+        Symbol * symbol = get_symbol(i);
+        if (symbol->storage != STORAGE_GLOBAL) continue;
+        global_label[i] = codetable_add_data(symbol->name, get_slot_size(symbol));
+    }
+}
+
+/**
+ * @return: 1 if the two Symbols can be live at the same time; locals of
+ *          blocks neither of which is nested in the other never are
+ */
+static int interferes(Symbol * a, Symbol * b) {
+    if (a->scope < 0 || b->scope < 0) return 1;
+    return a->scope <= b->scope_end && b->scope <= a->scope_end;
+}
+
+/**
+ * Orders the slots of a function by block, and within a block puts the
+ * word-aligned ones before the chars so no padding goes between them.
+ */
+static int compare_slots(const void * a, const void * b) {
+    Symbol * x = get_symbol(*(const int *) a);
+    Symbol * y = get_symbol(*(const int *) b);
+
+    if (x->scope != y->scope) return x->scope - y->scope;
+    if (get_slot_align(x) != get_slot_align(y)) return get_slot_align(y) - get_slot_align(x);
+    return *(const int *) a - *(const int *) b;
+}
+
+/**
+ * Lays out the frame of one function: the outgoing area and the area for
+ * registers saved around calls, the slots, its spill slots and the save
+ * area of its $s registers, and sets frame_size.  A slot goes right above
+ * the slots placed before it that interfere with it, so the locals of
+ * disjoint blocks share room, rounded up to its alignment.
+ */
+static void layout_frame(int fun, int spill_slots) {
+    int * order = (int *) malloc((get_symbol_count() + 1) * sizeof (int));
+    int * placed_end = (int *) malloc((get_symbol_count() + 1) * sizeof (int));
+    int count = 0;
+    int slots_size = 0;
+    int i, k;
+
+    frame_size = outgoing_size;
+    call_save_base = frame_size + 4;
+    frame_size += 4 * call_save_words;
+    for (i = 0; i < get_symbol_count(); i++) {
+        Symbol * symbol = get_symbol(i);
+        if (symbol->function != fun || symbol_reg[i] >= 0) continue;
+        if (symbol->storage != STORAGE_LOCAL
+                && (symbol->storage != STORAGE_PARAM || symbol->param_index >= ARG_REGISTER_COUNT))
+            continue;
+        order[count++] = i;
+    }
+    qsort(order, count, sizeof (int), compare_slots);
+    for (i = 0; i < count; i++) {
+        Symbol * symbol = get_symbol(order[i]);
+        int align = get_slot_align(symbol);
+        int offset = 0;
+        for (k = 0; k < i; k++)
+            if (placed_end[k] > offset && interferes(symbol, get_symbol(order[k])))
+                offset = placed_end[k];
+        offset = (offset + align - 1) / align * align;
+        slot_offset[order[i]] = frame_size + offset + 4;
+        placed_end[i] = offset + get_slot_size(symbol);
+        if (placed_end[i] > slots_size) slots_size = placed_end[i];
+    }
+    frame_size += (slots_size + 3) / 4 * 4;
+    free(order);
+    free(placed_end);
+    spill_base = frame_size + 4;
+    frame_size += 4 * spill_slots;
+    s_save_base = frame_size + 4;
+    frame_size += 4 * promoted_count;
+    for (i = 0; i < get_symbol_count(); i++) {
+        Symbol * symbol = get_symbol(i);
+        if (symbol->function == fun && symbol->storage == STORAGE_PARAM
+                && symbol->param_index >= ARG_REGISTER_COUNT) {
+            slot_offset[i] = frame_size + (save_ra ? 4 : 0) + 4 + 4 * (symbol->param_index - ARG_REGISTER_COUNT);
+        }
+    }
+}
+
+/**
+ * @return: 1 if the Symbol is a word-sized local or parameter whose
+ *          address is never taken
+ */
+static int is_promotable(Symbol * symbol) {
+    if (symbol->storage != STORAGE_LOCAL && symbol->storage != STORAGE_PARAM) return 0;
+    if (symbol->storage == STORAGE_PARAM && symbol->kind == SYM_ARRAY) return 1;   // a pointer
+    // chars would need truncating on every store
+    return symbol->kind == SYM_VARIABLE && symbol->type == T_INT;
+}
+
+/**
+ * Picks the Symbols of a function to keep in $s registers: the ones with
+ * the most accesses, each weighted by 8 to the power of its loop depth.
+ */
+static void choose_promotions(Ir_function * f) {
+    double * weight = (double *) calloc(get_symbol_count() + 1, sizeof (double));
+    int leaf = get_call_node(f->fun)->is_leaf;
+    int i, j, k;
+
+    for (i = 0; i < f->block_count; i++) {
+        double scale = 1;
+        for (k = 0; k < f->blocks[i].loop_depth && k < 6; k++)
+            scale *= 8;
+        for (j = 0; j < f->blocks[i].count; j++) {
+            Ir_inst * inst = &f->blocks[i].insts[j];
+            if (inst->sym < 0) continue;
+            if (inst->op == IR_ADDR)
+                weight[inst->sym] = -1e30;  // address taken
+            else if (inst->op == IR_LOAD || inst->op == IR_STORE)
+                weight[inst->sym] += scale;
+        }
+    }
+    promoted_count = 0;
+    while (promoted_count < S_REGISTER_COUNT) {
+        int best = -1;
+        for (i = 0; i < get_symbol_count(); i++) {
+            if (symbol_reg[i] >= 0 || get_symbol(i)->function != f->fun || !is_promotable(get_symbol(i)))
+                continue;
+            // no call clobbers the registers keep_params_in_registers() uses
+            if (leaf && get_symbol(i)->storage == STORAGE_PARAM && get_symbol(i)->param_index < ARG_REGISTER_COUNT)
+                continue;
+            if (weight[i] >= PROMOTE_MIN_WEIGHT && (best < 0 || weight[i] > weight[best])) best = i;
+        }
+        if (best < 0) break;
+        symbol_reg[best] = s0 + promoted_count;
+        promoted[promoted_count++] = best;
+    }
+    free(weight);
+}
+
+/**
+ * Lets virtual registers share the $s register of a promoted Symbol, so
+ * reading or writing it costs no move: a load whose value is only used in
+ * its block before the Symbol is stored again, and a value computed right
+ * before its only use, a store to the Symbol.
+ */
+static void alias_promoted(Ir_function * f) {
+    int * uses = (int *) calloc(f->vreg_count + 1, sizeof (int));
+    int * last_use = (int *) malloc((f->vreg_count + 1) * sizeof (int));
+    int i, j, k, p, q;
+
+    for (i = 0; i < f->block_count; i++) {
+        for (j = 0; j < f->blocks[i].count; j++) {
+            Ir_inst * inst = &f->blocks[i].insts[j];
+            int operands[2];
+            operands[0] = inst->a;
+            operands[1] = inst->b;
+            for (k = 0; k < 2 + inst->arg_count; k++) {
+                int v = (k < 2) ? operands[k] : inst->args[k - 2];
+                if (v < 0) continue;
+                uses[v]++;
+                last_use[v] = j;
+            }
+        }
+    }
+    // uses outside the defining block show up as an earlier or missing last use
+    for (i = 0; i < f->block_count; i++) {
+        Ir_block * block = &f->blocks[i];
+        int * local = (int *) calloc(f->vreg_count + 1, sizeof (int));
+        for (j = 0; j < block->count; j++) {
+            Ir_inst * inst = &block->insts[j];
+            if (inst->a >= 0) local[inst->a]++;
+            if (inst->b >= 0) local[inst->b]++;
+            for (k = 0; k < inst->arg_count; k++)
+                local[inst->args[k]]++;
+        }
+        for (p = 0; p < block->count; p++) {
+            Ir_inst * load = &block->insts[p];
+            int safe = 1;
+            if (load->op != IR_LOAD || load->sym < 0 || symbol_reg[load->sym] < 0) continue;
+            if (uses[load->dst] != local[load->dst] || uses[load->dst] == 0) continue;
+            for (q = p + 1; q < last_use[load->dst]; q++) {
+                Ir_inst * other = &block->insts[q];
+                if (other->op == IR_STORE && other->sym == load->sym) safe = 0;
+            }
+            if (safe) alloc.reg[load->dst] = symbol_reg[load->sym];
+        }
+        for (q = 1; q < block->count; q++) {
+            Ir_inst * store = &block->insts[q];
+            Ir_inst * def = &block->insts[q - 1];
+            if (store->op != IR_STORE || store->sym < 0 || symbol_reg[store->sym] < 0) continue;
+            if (def->dst != store->a || uses[store->a] != 1) continue;
+            if (def->op == IR_LOAD && def->sym >= 0 && symbol_reg[def->sym] >= 0) continue;
+            alloc.reg[store->a] = symbol_reg[store->sym];
+        }
+        free(local);
+    }
+    free(uses);
+    free(last_use);
+}
+
+/**
+ * Keeps the register parameters that are not promoted, and whose address
+ * is never taken, in the virtual register their IR_PARAM defines instead
+ * of a slot, so they stay in registers for as long as they are live and
+ * only calls make the allocator save them.  A store to one renames the
+ * value stored when it is computed right before and used only there, else
+ * becomes a move; a load whose value is only used in its block before the
+ * parameter is written again is replaced by the parameter's register,
+ * else becomes a move.
+ */
+static void keep_params_in_registers(Ir_function * f) {
+    int * param_vreg = (int *) malloc((get_symbol_count() + 1) * sizeof (int));
+    int * uses = (int *) calloc(f->vreg_count + 1, sizeof (int));
+    int * local = (int *) calloc(f->vreg_count + 1, sizeof (int));
+    Ir_block * entry = &f->blocks[0];
+    int i, j, k, q;
+
+    for (i = 0; i < get_symbol_count(); i++)
+        param_vreg[i] = -1;
+    for (j = 0; j + 1 < entry->count; j++) {
+        Ir_inst * param = &entry->insts[j];
+        Ir_inst * store = &entry->insts[j + 1];
+        if (param->op != IR_PARAM || store->op != IR_STORE || store->a != param->dst) continue;
+        if (symbol_reg[store->sym] < 0 && is_promotable(get_symbol(store->sym)))
+            param_vreg[store->sym] = param->dst;
+    }
+    for (i = 0; i < f->block_count; i++) {
+        for (j = 0; j < f->blocks[i].count; j++) {
+            Ir_inst * inst = &f->blocks[i].insts[j];
+            if (inst->op == IR_ADDR && inst->sym >= 0) param_vreg[inst->sym] = -1;
+            if (inst->a >= 0) uses[inst->a]++;
+            if (inst->b >= 0) uses[inst->b]++;
+            for (k = 0; k < inst->arg_count; k++)
+                uses[inst->args[k]]++;
+        }
+    }
+
+    for (i = 0; i < f->block_count; i++) {
+        Ir_block * block = &f->blocks[i];
+        for (j = 0; j < block->count; j++) {
+            Ir_inst * store = &block->insts[j];
+            int v;
+            if (store->op != IR_STORE || store->sym < 0 || param_vreg[store->sym] < 0) continue;
+            v = param_vreg[store->sym];
+            if (store->a == v) {
+                store->op = IR_NOP;
+                store->a = -1;
+            } else if (j > 0 && block->insts[j - 1].dst == store->a && uses[store->a] == 1) {
+                block->insts[j - 1].dst = v;
+                store->op = IR_NOP;
+                store->a = -1;
+            } else {
+                store->op = IR_MOVE;
+                store->dst = v;
+            }
+            store->sym = -1;
+        }
+    }
+
+    for (i = 0; i < f->block_count; i++) {
+        Ir_block * block = &f->blocks[i];
+        for (j = 0; j < block->count; j++) {
+            Ir_inst * inst = &block->insts[j];
+            if (inst->a >= 0) local[inst->a]++;
+            if (inst->b >= 0) local[inst->b]++;
+            for (k = 0; k < inst->arg_count; k++)
+                local[inst->args[k]]++;
+        }
+        for (j = 0; j < block->count; j++) {
+            Ir_inst * load = &block->insts[j];
+            int v, d, last, safe = 1;
+            if (load->op != IR_LOAD || load->sym < 0 || param_vreg[load->sym] < 0) continue;
+            v = param_vreg[load->sym];
+            d = load->dst;
+            load->sym = -1;
+            if (d == v) {
+                load->op = IR_NOP;
+                load->dst = -1;
+                continue;
+            }
+            load->op = IR_MOVE;
+            load->a = v;
+            if (uses[d] != local[d] || uses[d] == 0) continue;
+            for (last = block->count - 1; last > j; last--) {
+                Ir_inst * other = &block->insts[last];
+                int found = (other->a == d || other->b == d);
+                for (k = 0; k < other->arg_count; k++)
+                    if (other->args[k] == d) found = 1;
+                if (found) break;
+            }
+            for (q = j + 1; q < last; q++)
+                if (block->insts[q].dst == v) safe = 0;
+            if (!safe) continue;
+            for (q = j + 1; q <= last; q++) {
+                Ir_inst * other = &block->insts[q];
+                if (other->a == d) other->a = v;
+                if (other->b == d) other->b = v;
+                for (k = 0; k < other->arg_count; k++)
+                    if (other->args[k] == d) other->args[k] = v;
+            }
+            load->op = IR_NOP;
+            load->dst = load->a = -1;
+        }
+        for (j = 0; j < block->count; j++) {
+            Ir_inst * inst = &block->insts[j];
+            if (inst->a >= 0) local[inst->a] = 0;
+            if (inst->b >= 0) local[inst->b] = 0;
+            for (k = 0; k < inst->arg_count; k++)
+                local[inst->args[k]] = 0;
+        }
+    }
+    free(param_vreg);
+    free(uses);
+    free(local);
+}
+
+/**
+ * Gives the virtual registers that only ever hold 0, defined once by an
+ * IR_LI of 0, register $zero, so the li goes away.
+ */
+static void use_zero_register(Ir_function * f) {
+    int * defs = (int *) calloc(f->vreg_count + 1, sizeof (int));
+    int * zero = (int *) calloc(f->vreg_count + 1, sizeof (int));
+    int i, j;
+
+    for (i = 0; i < f->block_count; i++) {
+        for (j = 0; j < f->blocks[i].count; j++) {
+            Ir_inst * inst = &f->blocks[i].insts[j];
+            if (inst->dst < 0) continue;
+            defs[inst->dst]++;
+            if (inst->op == IR_LI && inst->imm == 0) zero[inst->dst] = 1;
+        }
+    }
+    for (i = 0; i < f->vreg_count; i++)
+        if (defs[i] == 1 && zero[i]) alloc.reg[i] = ZERO;
+    free(defs);
+    free(zero);
+}
+
+static int spill_offset(int vreg) {
+    return spill_base + 4 * alloc.spill_slot[vreg];
+}
+
+/**
+ * @return: register holding vreg; a spilled one is first reloaded into
+ *          scratch register which (0 or 1)
+ */
+static int use(int vreg, int which) {
+    if (vreg < 0) return -1;
+    if (alloc.reg[vreg] >= 0) return alloc.reg[vreg];
+    add_instruction(create_instruction_offset(LW, alloc.scratch[which], sp, 0, spill_offset(vreg)));
+    return alloc.scratch[which];
+}
+
+/**
+ * @return: register to compute vreg into, see commit()
+ */
+static int target(int vreg) {
+    if (vreg < 0) return -1;
+    return (alloc.reg[vreg] >= 0) ? alloc.reg[vreg] : alloc.scratch[0];
+}
+
+/**
+ * Stores a spilled vreg, just computed into its target(), to its slot.
+ */
+static void commit(int vreg) {
+    if (vreg >= 0 && alloc.reg[vreg] < 0)
+        add_instruction(create_instruction_offset(SW, alloc.scratch[0], sp, 0, spill_offset(vreg)));
+}
+
+/**
+ * Emits a load into reg, or a store of reg, for the memory operand of inst.
+ */
+static void select_memory(Instruction_type word, Instruction_type byte, Ir_inst * inst, int reg, int base) {
+    Instruction_type type = (inst->type == T_CHAR) ? byte : word;
+    int address;
+
+    if (inst->sym < 0) {
+        add_instruction(create_instruction_offset(type, reg, base, 0, inst->imm));
+    } else if (get_symbol(inst->sym)->storage == STORAGE_GLOBAL
+            && codetable_is_small_data(global_label[inst->sym])) {
+        add_instruction(create_instruction_data(type, reg, global_label[inst->sym], inst->imm));
+    } else if (get_symbol(inst->sym)->storage == STORAGE_GLOBAL) {
+        // one la per access; a load can form the address in its own destination
+        address = (inst->op == IR_LOAD) ? reg : alloc.scratch[1];
+        add_instruction(create_jump_label_instruction(LA, address, 0, global_label[inst->sym]));
+        add_instruction(create_instruction_offset(type, reg, address, 0, inst->imm));
+    } else {
+        add_instruction(create_instruction_offset(type, reg, sp, 0, slot_offset[inst->sym] + inst->imm));
+    }
+}
+
+/**
+ * Materializes dst = (a == b), or dst = (a != b) when negate is set,
+ * without a branch: a ^ b is 0 exactly when they are equal, and the xor
+ * is not needed when one side is $zero.
+ */
+static void select_equality(int negate, int a, int b, int dst) {
+    int diff = dst;
+
+    if (b == ZERO)
+        diff = a;
+    else if (a == ZERO)
+        diff = b;
+    else
+        add_instruction(create_instruction(XOR, dst, a, b));
+    if (negate)
+        add_instruction(create_instruction(SLTU, dst, ZERO, diff));
+    else
+        add_instruction(create_instruction(SLTIU, dst, diff, 1));
+}
+
+/**
+ * Branches to target[0] of inst when its condition holds, else to
+ * target[1], falling through when the target is the next block: the
+ * branch goes to the other target on the negated condition if target[0]
+ * follows.  A comparison with $zero, or a test of a alone, takes one of
+ * the branches that compare a register with zero.
+ */
+static void select_branch(Ir_inst * inst, int a, int b, int next) {
+    Ir_op compare = inst->compare;
+    int taken = inst->target[0];
+    int other = inst->target[1];
+    Instruction_type type;
+
+    if (compare == IR_NOP) {
+        compare = IR_SNE;
+        b = ZERO;
+    }
+    if (taken == next) {
+        compare = ir_negated(compare);
+        taken = other;
+        other = next;
+    }
+    if (a == ZERO) {
+        a = b;
+        b = ZERO;
+        compare = ir_swapped(compare);
+    }
+    if (b == ZERO) {
+        switch (compare) {
+            case IR_SLT: type = BLTZ; break;
+            case IR_SLE: type = BLEZ; break;
+            case IR_SGT: type = BGTZ; break;
+            case IR_SGE: type = BGEZ; break;
+            case IR_SEQ: type = BEQZ; break;
+            default: type = BNEZ; break;
+        }
+        add_instruction(create_jump_instruction(type, a, 0, LABEL_BLOCK, block_label[taken]));
+    } else {
+        switch (compare) {
+            case IR_SLT: type = BLT; break;
+            case IR_SLE: type = BLE; break;
+            case IR_SGT: type = BGT; break;
+            case IR_SGE: type = BGE; break;
+            case IR_SEQ: type = BEQ; break;
+            default: type = BNE; break;
+        }
+        add_instruction(create_jump_instruction(type, a, b, LABEL_BLOCK, block_label[taken]));
+    }
+    if (other != next)
+        add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_BLOCK, block_label[other]));
+}
+
+static void select_call(Ir_inst * inst) {
+    FunDef * fun = get_function(inst->sym);
+    int saved[32];
+    int saved_count = 0;
+    int dst;
+    int i;
+
+    for (i = 0; i < 32; i++)
+        if ((call_saves[call_index] >> i) & 1) saved[saved_count++] = i;
+    call_index++;
+    for (i = 0; i < saved_count; i++)
+        add_instruction(create_instruction_offset(SW, saved[i], sp, 0, call_save_base + i * 4));
+    for (i = ARG_REGISTER_COUNT; i < inst->arg_count; i++)
+        add_instruction(create_instruction_offset(SW, use(inst->args[i], 0), sp, 0, 4 + 4 * (i - ARG_REGISTER_COUNT)));
+    // an argument is only ever left in its own $a register, so these
+    // moves cannot clash
+    for (i = 0; i < inst->arg_count && i < ARG_REGISTER_COUNT; i++) {
+        if (alloc.reg[inst->args[i]] == a0 + i)
+            continue;
+        if (alloc.reg[inst->args[i]] >= 0)
+            add_instruction(create_instruction(MOVE, a0 + i, alloc.reg[inst->args[i]], 0));
+        else
+            add_instruction(create_instruction_offset(LW, a0 + i, sp, 0, spill_offset(inst->args[i])));
+    }
+    add_instruction(create_jump_label_instruction(JAL, 0, 0, fun->name));
+    for (i = 0; i < saved_count; i++)
+        add_instruction(create_instruction_offset(LW, saved[i], sp, 0, call_save_base + i * 4));
+
+    dst = target(inst->dst);
+    add_instruction(create_instruction(MOVE, dst, v0, 0));
+    commit(inst->dst);
+}
+
+static void select_inst(Ir_function * f, int block, Ir_inst * inst) {
+    int next = block + 1;
+    int a, b, dst;
+
+    if (inst->op == IR_CALL) {
+        select_call(inst);
+        return;
+    }
+    a = use(inst->a, 0);
+    b = use(inst->b, 1);
+    if (inst->op == IR_STORE) {
+        if (inst->sym >= 0 && symbol_reg[inst->sym] >= 0) {
+            if (a != symbol_reg[inst->sym])
+                add_instruction(create_instruction(MOVE, symbol_reg[inst->sym], a, 0));
+        } else
+            select_memory(SW, SB, inst, a, b);
+        return;
+    }
+    dst = target(inst->dst);
+
+    switch (inst->op) {
+        case IR_LI:
+            if (dst != ZERO) add_instruction(create_instruction(LI, dst, inst->imm, 0));
+            break;
+        case IR_MOVE:
+            if (dst != a) add_instruction(create_instruction(MOVE, dst, a, 0));
+            break;
+        case IR_ADD:
+            add_instruction(create_instruction(ADD, dst, a, b));
+            break;
+        case IR_SUB:
+            add_instruction(create_instruction(SUB, dst, a, b));
+            break;
+        case IR_ADDU:
+            add_instruction(create_instruction(ADDU, dst, a, b));
+            break;
+        case IR_SUBU:
+            add_instruction(create_instruction(SUBU, dst, a, b));
+            break;
+        case IR_MUL:
+            add_instruction(create_instruction(MUL, dst, a, b));
+            break;
+        case IR_DIV:
+            add_instruction(create_instruction(DIV_I, a, b, 0));
+            add_instruction(create_instruction(MFLO, dst, 0, 0));
+            break;
+        case IR_SLL:
+            add_instruction(create_instruction(SLL, dst, a, inst->imm));
+            break;
+        case IR_SRA:
+            add_instruction(create_instruction(SRA, dst, a, inst->imm));
+            break;
+        case IR_SRL:
+            add_instruction(create_instruction(SRL, dst, a, inst->imm));
+            break;
+        case IR_ADDI:
+            add_instruction(create_instruction(ADDI, dst, a, inst->imm));
+            break;
+        case IR_SLTI:
+            add_instruction(create_instruction(SLTI, dst, a, inst->imm));
+            break;
+        case IR_XORI:
+            add_instruction(create_instruction(XORI, dst, a, inst->imm));
+            break;
+        case IR_MULHI:
+            add_instruction(create_instruction(MULT_I, a, b, 0));
+            add_instruction(create_instruction(MFHI, dst, 0, 0));
+            break;
+        case IR_SLT:
+            add_instruction(create_instruction(SLT, dst, a, b));
+            break;
+        case IR_SGT:
+            add_instruction(create_instruction(SLT, dst, b, a));
+            break;
+        case IR_SLE:
+            // a <= b is !(b < a), a >= b is !(a < b)
+            add_instruction(create_instruction(SLT, dst, b, a));
+            add_instruction(create_instruction(XORI, dst, dst, 1));
+            break;
+        case IR_SGE:
+            add_instruction(create_instruction(SLT, dst, a, b));
+            add_instruction(create_instruction(XORI, dst, dst, 1));
+            break;
+        case IR_SEQ:
+        case IR_SNE:
+            select_equality(inst->op == IR_SNE, a, b, dst);
+            break;
+        case IR_NEG:
+            add_instruction(create_instruction(SUB, dst, ZERO, a));
+            break;
+        case IR_NOT:
+            add_instruction(create_instruction(SLTIU, dst, a, 1));
+            break;
+        case IR_ADDR:
+            if (get_symbol(inst->sym)->storage == STORAGE_GLOBAL) {
+                add_instruction(create_jump_label_instruction(LA, dst, 0, global_label[inst->sym]));
+                if (inst->imm != 0) add_instruction(create_instruction(ADDI, dst, dst, inst->imm));
+            } else {
+                add_instruction(create_instruction(ADDI, dst, sp, slot_offset[inst->sym] + inst->imm));
+            }
+            break;
+        case IR_LOAD:
+            if (inst->sym >= 0 && symbol_reg[inst->sym] >= 0) {
+                if (dst != symbol_reg[inst->sym])
+                    add_instruction(create_instruction(MOVE, dst, symbol_reg[inst->sym], 0));
+            } else
+                select_memory(LW, LB, inst, dst, b);
+            break;
+        case IR_PARAM:
+            if (dst != a0 + inst->imm) add_instruction(create_instruction(MOVE, dst, a0 + inst->imm, 0));
+            break;
+        case IR_READ:
+            add_read(inst->type == T_CHAR);
+            add_instruction(create_instruction(MOVE, dst, v0, 0));
+            break;
+        case IR_WRITE:
+            if (a != a0) add_instruction(create_instruction(MOVE, a0, a, 0));
+            add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_WRITE_INT));
+            break;
+        case IR_WRITELN:
+            add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_WRITELN));
+            break;
+        case IR_JUMP:
+            if (inst->target[0] != next)
+                add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_BLOCK, block_label[inst->target[0]]));
+            break;
+        case IR_BRANCH:
+            select_branch(inst, a, b, next);
+            break;
+        case IR_RET:
+            if (a >= 0) add_instruction(create_instruction(MOVE, v0, a, 0));
+            if (next < f->block_count)
+                add_instruction(create_jump_instruction(J_I, 0, 0, LABEL_BLOCK, exit_label));
+            break;
+        default:
+            break;
+    }
+    commit(inst->dst);
+}
+
+/**
+ * Finds the registers to save at every call: those holding a value that
+ * is defined before the call and used after it.  $s registers are saved
+ * by the callee and the $a registers never hold such a value.  Also sizes
+ * the save area and the outgoing area of the frame.
+ * @return: number of registers saved, over all calls
+ */
+static int find_call_saves(Ir_function * f) {
+    int * call_position;
+    int call_count = 0;
+    int total = 0;
+    int b, j, k, v, p;
+
+    outgoing_size = 0;
+    for (b = 0; b < f->block_count; b++) {
+        for (j = 0; j < f->blocks[b].count; j++) {
+            Ir_inst * inst = &f->blocks[b].insts[j];
+            if (inst->op != IR_CALL) continue;
+            call_count++;
+            if (get_stack_argument_size(get_function(inst->sym)) > outgoing_size)
+                outgoing_size = get_stack_argument_size(get_function(inst->sym));
+        }
+    }
+    call_position = (int *) malloc((call_count + 1) * sizeof (int));
+    call_count = 0;
+    p = 0;
+    for (b = 0; b < f->block_count; b++)
+        for (j = 0; j < f->blocks[b].count; j++, p++)
+            if (f->blocks[b].insts[j].op == IR_CALL) call_position[call_count++] = p;
+
+    call_saves = (unsigned int *) calloc(call_count + 1, sizeof (unsigned int));
+    for (v = 0; v < f->vreg_count; v++) {
+        int reg = alloc.reg[v];
+        if (reg <= ZERO || alloc.end[v] < 0 || (reg >= s0 && reg < s0 + S_REGISTER_COUNT)) continue;
+        for (k = 0; k < call_count; k++) {
+            if (call_position[k] <= alloc.start[v] || call_position[k] >= alloc.end[v]) continue;
+            if (!((call_saves[k] >> reg) & 1)) total++;
+            call_saves[k] |= 1u << reg;
+        }
+    }
+    call_save_words = 0;
+    for (k = 0; k < call_count; k++) {
+        int words = 0;
+        for (v = 0; v < 32; v++)
+            words += (call_saves[k] >> v) & 1;
+        if (words > call_save_words) call_save_words = words;
+    }
+    call_index = 0;
+    free(call_position);
+    return total;
+}
+
+static void select_function(Ir_function * f) {
+    FunDef * fun = get_function(f->fun);
+    int i, j;
+
+    choose_promotions(f);
+    keep_params_in_registers(f);
+    regalloc_function(f, &alloc);
+    alias_promoted(f);
+    use_zero_register(f);
+    stats_add(fun->name, "vregs", f->vreg_count);
+    stats_add(fun->name, "spills", alloc.spill_count);
+    stats_add(fun->name, "promoted", promoted_count);
+    stats_add(fun->name, "call saves", find_call_saves(f));
+
+    block_label = (int *) malloc((f->block_count + 1) * sizeof (int));
+    for (i = 0; i < f->block_count; i++)
+        block_label[i] = get_next_label_sn(LABEL_BLOCK);
+    exit_label = get_next_label_sn(LABEL_BLOCK);
+    save_ra = !get_call_node(f->fun)->is_leaf;
+    layout_frame(f->fun, alloc.spill_slot_count);
+    stats_add(fun->name, "frame", frame_size);
+
+    add_instruction(create_instruction_named_label(FUNCTION, fun->name));
+    add_prologue(frame_size, save_ra);
+    for (i = 0; i < promoted_count; i++) {
+        Symbol * symbol = get_symbol(promoted[i]);
+        add_instruction(create_instruction_offset(SW, s0 + i, sp, 0, s_save_base + 4 * i));
+        // stack parameters arrive in the caller's frame
+        if (symbol->storage == STORAGE_PARAM && symbol->param_index >= ARG_REGISTER_COUNT)
+            add_instruction(create_instruction_offset(LW, s0 + i, sp, 0, slot_offset[promoted[i]]));
+    }
+
+    for (i = 0; i < f->block_count; i++) {
+        add_instruction(create_instruction_label(LABEL_BLOCK, block_label[i]));
+        for (j = 0; j < f->blocks[i].count; j++)
+            select_inst(f, i, &f->blocks[i].insts[j]);
+    }
+
+    add_instruction(create_instruction_label(LABEL_BLOCK, exit_label));
+    if (strcmp(fun->name, "main") == 0)
+        add_instruction(create_jump_label_instruction(JAL, 0, 0, RUNTIME_FLUSH));
+    for (i = 0; i < promoted_count; i++)
+        add_instruction(create_instruction_offset(LW, s0 + i, sp, 0, s_save_base + 4 * i));
+    add_epilogue(frame_size, save_ra);
+
+    regalloc_free(&alloc);
+    free(call_saves);
+    call_saves = NULL;
+    for (i = 0; i < promoted_count; i++)
+        symbol_reg[promoted[i]] = -1;
+    free(block_label);
+    block_label = NULL;
+}
+
+void ir_codegen() {
+    int i;
+
+    codetable_init();
+    slot_offset = (int *) calloc(get_symbol_count() + 1, sizeof (int));
+    global_label = (const char **) calloc(get_symbol_count() + 1, sizeof (const char *));
+    symbol_reg = (int *) malloc((get_symbol_count() + 1) * sizeof (int));
+    for (i = 0; i < get_symbol_count(); i++)
+        symbol_reg[i] = -1;
+    allocate_globals();
+    for (i = 0; i < get_ir_function_count(); i++)
+        select_function(get_ir_function(i));
+    free(slot_offset);
+    free(global_label);
+    free(symbol_reg);
+    slot_offset = NULL;
+    global_label = NULL;
+    symbol_reg = NULL;
+}
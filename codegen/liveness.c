@@ -0,0 +1,460 @@
+// liveness of registers and frame slots, the first client of dataflow.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include "liveness.h"
+#include "dataflow.h"
+
+#define ALL_SLOTS -2
+#define SP_UNKNOWN INT_MIN
+// out of range registers, e.g. a failed allocation, read and write nothing
+#define REG_BIT(reg) ((unsigned) (reg) < 32 ? 1u << (reg) : 0u)
+
+// registers a callee may change: $at, $v0-$v1, $a0-$a3, $t0-$t9, $ra
+#define CALLER_SAVED (REG_BIT(at) | REG_BIT(v0) | REG_BIT(v1) | 0xf0u | 0xff00u \
+        | REG_BIT(t8) | REG_BIT(t9) | REG_BIT(ra))
+#define CALLEE_SAVED 0xff0000u  // $s0-$s7
+
+typedef struct {
+    unsigned int reg_use;
+    unsigned int reg_def;
+    int slot_use;       // slot read, ALL_SLOTS or -1
+    int slot_def;       // slot overwritten as a whole word, or -1
+} Effect;
+
+typedef struct {
+    Dataflow * flow;
+    int tracks_slots;   // $sp is known at every reachable instruction
+    int escapes;        // some register receives an address formed from $sp
+    int slot_base;      // word address of slot 0, relative to $sp at entry
+    int slot_count;
+} Function_liveness;
+
+static Function_liveness * functions = NULL;
+static int function_count = 0;
+static int * block_sp = NULL;       // $sp at the start of each block, relative to entry
+static Effect * effects = NULL;     // scratch for the instructions of one block
+static int effects_max = 0;
+static double elapsed = 0;
+
+static int floor_div4(int address) {
+    return (address >= 0) ? address / 4 : -((-address + 3) / 4);
+}
+
+/**
+ * @return: 1 and the amount in delta if l moves $sp by a known amount,
+ *          -1 if it sets $sp to something unknown, 0 if it leaves it alone
+ */
+static int sp_change(Instruction_line * l, int * delta) {
+    if (l->type == ADDI && l->dest_reg == sp && l->reg1 == sp) {
+        *delta = l->reg2;
+        return 1;
+    }
+    switch (l->type) {
+        case SW:
+        case SB:
+        case DIV_I:
+        case MULT_I:
+        case LABEL:
+        case BEQZ:
+        case BNEZ:
+        case BLTZ:
+        case BGEZ:
+        case BLEZ:
+        case BGTZ:
+        case B_I:
+        case BGE:
+        case BLE:
+        case BLT:
+        case BGT:
+        case BEQ:
+        case BNE:
+        case J_I:
+        case JAL:
+        case SYSCALL:
+            return 0;
+        default:
+            return (l->dest_reg == sp) ? -1 : 0;
+    }
+}
+
+static int is_memory(Instruction_line * l) {
+    return l->type == LW || l->type == LB || l->type == SW || l->type == SB;
+}
+
+static void compute_block_sp(int function) {
+    Cfg_function * fun = get_cfg_function(function);
+    Function_liveness * info = &functions[function];
+    int * stack = (int *) malloc((fun->block_count + 1) * sizeof (int));
+    int top = 0;
+    int i, j, delta;
+
+    for (i = 0; i < fun->block_count; i++)
+        block_sp[fun->entry + i] = SP_UNKNOWN;
+    info->tracks_slots = 1;
+    if (fun->block_count == 0) {
+        free(stack);
+        return;
+    }
+    block_sp[fun->entry] = 0;
+    stack[top++] = fun->entry;
+    while (top > 0) {
+        int b = stack[--top];
+        Cfg_block * block = get_cfg_block(b);
+        int current = block_sp[b];
+
+        for (j = block->first; j <= block->last && current != SP_UNKNOWN; j++) {
+            switch (sp_change(get_instruction(j), &delta)) {
+                case 1:
+                    current += delta;
+                    break;
+                case -1:
+                    current = SP_UNKNOWN;
+                    break;
+            }
+        }
+        if (current == SP_UNKNOWN) {
+            info->tracks_slots = 0;
+            continue;
+        }
+        for (j = 0; j < block->succ_count; j++) {
+            int s = block->succ[j];
+            if (block_sp[s] == SP_UNKNOWN) {
+                block_sp[s] = current;
+                stack[top++] = s;
+            } else if (block_sp[s] != current) {
+                info->tracks_slots = 0;
+            }
+        }
+    }
+    free(stack);
+}
+
+/**
+ * Finds the words of the frame addressed from $sp and whether $sp escapes.
+ */
+static void layout_slots(int function) {
+    Cfg_function * fun = get_cfg_function(function);
+    Function_liveness * info = &functions[function];
+    int low = INT_MAX, high = INT_MIN;
+    int b, j, delta;
+
+    info->escapes = 0;
+    for (b = fun->entry; b < fun->entry + fun->block_count; b++) {
+        Cfg_block * block = get_cfg_block(b);
+        int current = block_sp[b];
+
+        for (j = block->first; j <= block->last; j++) {
+            Instruction_line * l = get_instruction(j);
+            if (is_memory(l)) {
+                if (l->reg1 == sp && current != SP_UNKNOWN) {
+                    int word = floor_div4(current + l->offset);
+                    if (word < low) low = word;
+                    if (word > high) high = word;
+                }
+            } else if (l->dest_reg != sp
+                    && (((l->type == ADDI || l->type == MOVE || l->type == ADD) && l->reg1 == sp)
+                        || (l->type == ADD && l->reg2 == sp))) {
+                info->escapes = 1;
+            }
+            if (current != SP_UNKNOWN && sp_change(l, &delta) == 1)
+                current += delta;
+        }
+    }
+    if (!info->tracks_slots || low > high) {
+        info->slot_base = 0;
+        info->slot_count = 0;
+    } else {
+        info->slot_base = low;
+        info->slot_count = high - low + 1;
+    }
+}
+
+/**
+ * Describes the registers and slots one instruction reads and writes.
+ */
+static void get_effect(Function_liveness * info, Instruction_line * l, int current, Effect * e) {
+    e->reg_use = e->reg_def = 0;
+    e->slot_use = e->slot_def = -1;
+
+    switch (l->type) {
+        case LI:
+        case LA:
+        case MFLO:
+        case MFHI:
+            e->reg_def = REG_BIT(l->dest_reg);
+            break;
+        case MOVE:
+        case NOT_I:
+        case ADDI:
+        case SLTI:
+        case SLTIU:
+        case XORI:
+        case SLL:
+        case SRA:
+        case SRL:
+            e->reg_def = REG_BIT(l->dest_reg);
+            e->reg_use = REG_BIT(l->reg1);
+            break;
+        case MOVZ:
+            e->reg_def = REG_BIT(l->dest_reg);
+            e->reg_use = REG_BIT(l->dest_reg) | REG_BIT(l->reg1) | REG_BIT(l->reg2);
+            break;
+        case DIV_I:
+        case MULT_I:
+        case BGE:
+        case BLE:
+        case BLT:
+        case BGT:
+        case BEQ:
+        case BNE:
+            e->reg_use = REG_BIT(l->dest_reg) | REG_BIT(l->reg1);
+            break;
+        case BEQZ:
+        case BNEZ:
+        case BLTZ:
+        case BGEZ:
+        case BLEZ:
+        case BGTZ:
+            e->reg_use = REG_BIT(l->dest_reg);
+            break;
+        case LW:
+        case LB:
+        case SW:
+        case SB:
+            if (l->type == LW || l->type == LB) {
+                e->reg_def = REG_BIT(l->dest_reg);
+                e->reg_use = REG_BIT(l->reg1);
+            } else {
+                e->reg_use = REG_BIT(l->dest_reg) | REG_BIT(l->reg1);
+            }
+            if (info->slot_count == 0) break;
+            if (l->reg1 == sp && current != SP_UNKNOWN) {
+                int address = current + l->offset;
+                int slot = floor_div4(address) - info->slot_base;
+                if (l->type == SW && (address & 3) == 0)
+                    e->slot_def = slot;
+                else if (l->type != SB)
+                    e->slot_use = slot;
+            } else if (l->type == LW || l->type == LB) {
+                if (info->escapes || l->reg1 == sp) e->slot_use = ALL_SLOTS;
+            }
+            break;
+        case SYSCALL:
+            e->reg_use = REG_BIT(v0) | REG_BIT(a0);
+            e->reg_def = REG_BIT(v0);
+            break;
+        case JAL:
+            if (is_runtime_routine(l->label_name)) {
+                // the output runtime keeps every register but these
+                e->reg_use = REG_BIT(a0) | REG_BIT(sp) | REG_BIT(gp);
+                e->reg_def = REG_BIT(a0) | REG_BIT(v0) | REG_BIT(ra);
+                break;
+            }
+            e->reg_use = REG_BIT(a0) | REG_BIT(a1) | REG_BIT(a2) | REG_BIT(a3) | REG_BIT(sp) | REG_BIT(gp);
+            e->reg_def = CALLER_SAVED;
+            if (info->slot_count > 0) e->slot_use = ALL_SLOTS;
+            break;
+        case JR:
+            // the return: the caller's registers and the result
+            e->reg_use = REG_BIT(ra) | REG_BIT(sp) | REG_BIT(v0) | REG_BIT(gp) | CALLEE_SAVED;
+            break;
+        case LABEL:
+        case B_I:
+        case J_I:
+            break;
+        default:
+            // three-register arithmetic and logic
+            e->reg_def = REG_BIT(l->dest_reg);
+            e->reg_use = REG_BIT(l->reg1) | REG_BIT(l->reg2);
+            break;
+    }
+    e->reg_use &= ~REG_BIT(ZERO);
+    e->reg_def &= ~REG_BIT(ZERO);
+}
+
+/**
+ * Fills effects[] for the instructions of a block, first to last.
+ */
+static void get_block_effects(int function, int b) {
+    Function_liveness * info = &functions[function];
+    Cfg_block * block = get_cfg_block(b);
+    int length = block->last - block->first + 1;
+    int current = block_sp[b];
+    int j, delta;
+
+    if (length > effects_max) {
+        effects_max = length * 2;
+        effects = (Effect *) realloc(effects, effects_max * sizeof (Effect));
+    }
+    for (j = 0; j < length; j++) {
+        Instruction_line * l = get_instruction(block->first + j);
+        get_effect(info, l, current, &effects[j]);
+        if (current != SP_UNKNOWN) {
+            switch (sp_change(l, &delta)) {
+                case 1:
+                    current += delta;
+                    break;
+                case -1:
+                    current = SP_UNKNOWN;
+                    break;
+            }
+        }
+    }
+}
+
+static void use_slots(Function_liveness * info, Bitset set, int slot) {
+    int i;
+
+    if (slot == ALL_SLOTS) {
+        for (i = 0; i < info->slot_count; i++)
+            bitset_set(set, LIVENESS_SLOT_BIT + i);
+    } else if (slot >= 0) {
+        bitset_set(set, LIVENESS_SLOT_BIT + slot);
+    }
+}
+
+/**
+ * Moves a live set from after an instruction to before it.
+ */
+static void step_back(Function_liveness * info, Effect * e, Bitset live) {
+    live[0] = (live[0] & ~e->reg_def) | e->reg_use;
+    if (e->slot_def >= 0) bitset_clear(live, LIVENESS_SLOT_BIT + e->slot_def);
+    use_slots(info, live, e->slot_use);
+}
+
+static void analyze_function(int function) {
+    Cfg_function * fun = get_cfg_function(function);
+    Function_liveness * info = &functions[function];
+    Dataflow * flow;
+    int b, j;
+
+    compute_block_sp(function);
+    layout_slots(function);
+    flow = info->flow = dataflow_new(function, DATAFLOW_BACKWARD, DATAFLOW_UNION,
+            LIVENESS_SLOT_BIT + info->slot_count);
+
+    for (b = 0; b < fun->block_count; b++) {
+        Cfg_block * block = get_cfg_block(fun->entry + b);
+        Bitset gen = flow->gen[b];
+        Bitset kill = flow->kill[b];
+
+        get_block_effects(function, fun->entry + b);
+        for (j = block->last - block->first; j >= 0; j--) {
+            Effect * e = &effects[j];
+            gen[0] = (gen[0] & ~e->reg_def) | e->reg_use;
+            kill[0] |= e->reg_def;
+            if (e->slot_def >= 0) {
+                bitset_clear(gen, LIVENESS_SLOT_BIT + e->slot_def);
+                bitset_set(kill, LIVENESS_SLOT_BIT + e->slot_def);
+            }
+            use_slots(info, gen, e->slot_use);
+        }
+    }
+    dataflow_solve(flow);
+}
+
+void liveness_build() {
+    clock_t start = clock();
+    int i;
+
+    liveness_destroy();
+    function_count = get_cfg_function_count();
+    functions = (Function_liveness *) calloc(function_count + 1, sizeof (Function_liveness));
+    block_sp = (int *) malloc((get_cfg_block_count() + 1) * sizeof (int));
+    for (i = 0; i < function_count; i++)
+        analyze_function(i);
+    elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+void liveness_destroy() {
+    int i;
+
+    for (i = 0; i < function_count; i++)
+        dataflow_free(functions[i].flow);
+    free(functions);
+    free(block_sp);
+    free(effects);
+    functions = NULL;
+    block_sp = NULL;
+    effects = NULL;
+    function_count = effects_max = 0;
+}
+
+int get_liveness_words(int function) {
+    return functions[function].flow->words;
+}
+
+int get_slot_count(int function) {
+    return functions[function].slot_count;
+}
+
+int get_slot_base(int function) {
+    return functions[function].slot_base * 4;
+}
+
+Bitset get_live_in(int block) {
+    Function_liveness * info = &functions[get_cfg_block(block)->function];
+    return info->flow->in[block - info->flow->first_block];
+}
+
+Bitset get_live_out(int block) {
+    Function_liveness * info = &functions[get_cfg_block(block)->function];
+    return info->flow->out[block - info->flow->first_block];
+}
+
+void get_live_after(int instruction, Bitset live) {
+    int b = get_instruction_block(instruction);
+    Cfg_block * block = get_cfg_block(b);
+    int function = block->function;
+    Function_liveness * info = &functions[function];
+    int j;
+
+    bitset_copy(live, get_live_out(b), info->flow->words);
+    get_block_effects(function, b);
+    for (j = block->last; j > instruction; j--)
+        step_back(info, &effects[j - block->first], live);
+}
+
+static void dump_set(FILE * out, Function_liveness * info, Bitset set) {
+    int bit;
+
+    for (bit = bitset_next(set, 0, info->flow->words); bit >= 0;
+            bit = bitset_next(set, bit + 1, info->flow->words)) {
+        if (bit < LIVENESS_SLOT_BIT)
+            fprintf(out, " $%d", bit);
+        else
+            fprintf(out, " sp%+d", (info->slot_base + bit - LIVENESS_SLOT_BIT) * 4);
+    }
+}
+
+void liveness_dump(FILE * out) {
+    int blocks = 0, instructions = 0, visits = 0;
+    int i, b;
+
+    for (i = 0; i < function_count; i++) {
+        Cfg_function * fun = get_cfg_function(i);
+        Function_liveness * info = &functions[i];
+        int count = 0;
+
+        for (b = fun->entry; b < fun->entry + fun->block_count; b++)
+            count += get_cfg_block(b)->last - get_cfg_block(b)->first + 1;
+        fprintf(out, "# liveness of %s: %d blocks, %d instructions, %d slots%s, %d visits\n",
+                fun->name ? fun->name : "(no function)", fun->block_count, count,
+                info->slot_count, info->tracks_slots ? "" : " (not tracked)", info->flow->visits);
+        for (b = fun->entry; b < fun->entry + fun->block_count; b++) {
+            fprintf(out, "B%d in:", b);
+            dump_set(out, info, get_live_in(b));
+            fprintf(out, "\nB%d out:", b);
+            dump_set(out, info, get_live_out(b));
+            fprintf(out, "\n");
+        }
+        blocks += fun->block_count;
+        instructions += count;
+        visits += info->flow->visits;
+    }
+    fprintf(out, "# liveness: %d functions, %d blocks, %d instructions, %d visits, %.3f s\n",
+            function_count, blocks, instructions, visits, elapsed);
+}
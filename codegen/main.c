@@ -3,24 +3,73 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include "codegen.h"
 #include "parser.h"
+#include "semantic.h"
+#include "callgraph.h"
+#include "fold.h"
+#include "ir.h"
+#include "codetable.h"
+#include "cfg.h"
+#include "liveness.h"
+#include "stats.h"
 
 
+static void usage() {
+  printf("usage: mycc  [-O0|-O1]  [--dump-callgraph]  [--dump-ir]  [--dump-cfg]  [--dump-liveness]  [--stats]  [--buffered-input]  filename.c--  filename.mips\n");
+  printf("  -O0  emit code straight from the AST\n");
+  printf("  -O1  emit code through the IR with register allocation (default)\n");
+  printf("  --buffered-input  read input in blocks instead of one syscall per value\n");
+  exit(1);
+}
+
 int main(int argc, char *argv[]) {
 
   FILE *in = 0, *out = 0;
+  const char *files[2];
+  int num_files = 0;
+  int dump_callgraph = 0;
+  int dump_ir = 0;
+  int dump_cfg = 0;
+  int dump_liveness = 0;
+  int show_stats = 0;
+  int opt_level = 1;
+  int i;
 
-  if(argc != 3) {
-    printf("usage: mycc  filename.c--  filename.mips\n");
-    exit(1);
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--dump-callgraph")) {
+      dump_callgraph = 1;
+    } else if (!strcmp(argv[i], "--dump-ir")) {
+      dump_ir = 1;
+    } else if (!strcmp(argv[i], "--dump-cfg")) {
+      dump_cfg = 1;
+    } else if (!strcmp(argv[i], "--dump-liveness")) {
+      dump_liveness = 1;
+    } else if (!strcmp(argv[i], "--stats")) {
+      show_stats = 1;
+    } else if (!strcmp(argv[i], "--buffered-input")) {
+      codetable_set_buffered_input(1);
+    } else if (!strcmp(argv[i], "-O0")) {
+      opt_level = 0;
+    } else if (!strcmp(argv[i], "-O1")) {
+      opt_level = 1;
+    } else if (argv[i][0] == '-') {
+      usage();
+    } else if (num_files < 2) {
+      files[num_files++] = argv[i];
+    } else {
+      usage();
+    }
   }
-  if(!(in = fopen(argv[1], "rw")) ) {
+  if (num_files != 2) usage();
+
+  if(!(in = fopen(files[0], "rw")) ) {
     perror("no such file\n");
     exit(1);
   }
-  if(!(out = fopen(argv[2], "w")) ) {
+  if(!(out = fopen(files[1], "w")) ) {
     perror("opening output file faild\n");
     exit(1);
   }
@@ -30,9 +79,38 @@ int main(int argc, char *argv[]) {
   //
   // init_symtab(); ...   // call any initialization routines here
   parse(in);   // call your main parse routine
-  codegen(out, ast_tree.root);   // call your main code generation routine to fill codetable 
-  //generate_code_from_codetable(out);   // write MIPS code from codetable to
-                                       // output file
+  if (semantic_analysis(ast_tree.root) > 0) {   // reports every error it finds
+    exit(1);
+  }
+  fold_constants();
+  callgraph_build();
+  if (dump_callgraph) callgraph_dump(stdout);
+  if (opt_level == 0) {
+    codegen(ast_tree.root);   // call your main code generation routine to fill codetable 
+  } else {
+    ir_lower(ast_tree.root);
+    if (dump_ir) ir_dump(stdout);
+    ir_codegen();
+    ir_destroy();
+  }
+  if (dump_cfg || dump_liveness) {
+    cfg_build();
+    if (dump_cfg) cfg_dump(stdout);
+    if (dump_liveness) {
+      liveness_build();
+      liveness_dump(stdout);
+      liveness_destroy();
+    }
+    cfg_destroy();
+  }
+  if (codetable_print(out) == 0) {   // write MIPS code from codetable to output file
+    printf("Success\n");
+  } else {
+    printf("Error writing instructions\n");
+  }
+  codetable_destroy();
+  if (show_stats) stats_dump(stdout);
+  stats_destroy();
   fclose(in);
   fclose(out);
 
@@ -0,0 +1,326 @@
+// linear-scan register allocator over IR virtual registers
+
+#include <stdlib.h>
+#include <limits.h>
+#include "codetable.h"
+#include "regalloc.h"
+
+#define REG_BIT(reg) (1u << (reg))
+#define A_REGISTERS (REG_BIT(a0) | REG_BIT(a1) | REG_BIT(a2) | REG_BIT(a3))
+#define POOL_SIZE 15
+
+// allocation order: temporaries first, then $v1, then the argument registers
+static const int pool[POOL_SIZE] = {
+    t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, v1, a3, a2, a1, a0
+};
+
+typedef struct {
+    int vreg;
+    int start;
+    int end;
+    unsigned int allowed;
+    int prefer;             // register to take when free, -1 for none
+} Interval;
+
+static Interval * intervals = NULL;
+static int interval_count = 0;
+
+static int compare_start(const void * a, const void * b) {
+    const Interval * x = (const Interval *) a;
+    const Interval * y = (const Interval *) b;
+
+    if (x->start != y->start) return x->start - y->start;
+    return x->vreg - y->vreg;
+}
+
+/**
+ * @return: 1 if a store to the Symbol needs a register for its address,
+ *          a global too large for the area addressed from $gp
+ */
+static int is_large_global(int sym) {
+    Symbol * symbol = get_symbol(sym);
+    int size = (symbol->type == T_INT) ? 4 : 1;
+
+    if (symbol->kind == SYM_ARRAY) size *= symbol->count;
+    return symbol->storage == STORAGE_GLOBAL && (size + 3) / 4 * 4 > SMALL_DATA_SIZE;
+}
+
+static void touch(int * start, int * end, int vreg, int position) {
+    if (vreg < 0) return;
+    if (position < start[vreg]) start[vreg] = position;
+    if (position > end[vreg]) end[vreg] = position;
+}
+
+/**
+ * Stretches intervals live into a loop header to the end of the loop.
+ * Virtual registers are defined before their uses in block order, so an
+ * interval is live into a header exactly when it starts before the header
+ * and ends at or after it.
+ */
+static void extend_over_loops(Ir_function * f, int * block_start, int * start, int * end) {
+    int * crossing = (int *) malloc((f->vreg_count + 1) * sizeof (int));
+    int crossing_count = 0;
+    int * block_of = NULL;
+    int total = block_start[f->block_count];
+    int changed = 1;
+    int b, i, k, v, p;
+
+    // only intervals that span a block boundary can be live into a header
+    block_of = (int *) malloc((total + 1) * sizeof (int));
+    for (b = 0; b < f->block_count; b++)
+        for (p = block_start[b]; p < block_start[b + 1]; p++)
+            block_of[p] = b;
+    for (v = 0; v < f->vreg_count; v++)
+        if (end[v] >= 0 && block_of[start[v]] != block_of[end[v]])
+            crossing[crossing_count++] = v;
+
+    while (changed && crossing_count > 0) {
+        changed = 0;
+        for (b = 0; b < f->block_count; b++) {
+            int succ[2];
+            int n = ir_successors(f, b, succ);
+            for (k = 0; k < n; k++) {
+                int header = block_start[succ[k]];
+                int tail = block_start[b + 1] - 1;
+                if (succ[k] > b) continue;
+                for (i = 0; i < crossing_count; i++) {
+                    v = crossing[i];
+                    if (start[v] < header && end[v] >= header && end[v] < tail) {
+                        end[v] = tail;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+    free(crossing);
+    free(block_of);
+}
+
+/**
+ * Builds the intervals, kept in start and end, and the registers each may use.
+ * @return: 1 if the function stores to a global outside the $gp area
+ */
+static int build_intervals(Ir_function * f, int * start, int * end) {
+    int * block_start = (int *) malloc((f->block_count + 1) * sizeof (int));
+    int * calls_upto;       // calls at positions <= p
+    int * writes_upto;      // reads and writes (the runtime changes $a0) at positions <= p
+    unsigned int * arg_registers;   // $a registers a call ending the interval passes it in
+    int * prefer;
+    int param_position[4] = { -1, -1, -1, -1 };
+    int global_store = 0;
+    int total = 0;
+    int b, j, k, v, p;
+
+    for (b = 0; b < f->block_count; b++) {
+        block_start[b] = total;
+        total += f->blocks[b].count;
+    }
+    block_start[f->block_count] = total;
+    calls_upto = (int *) calloc(total + 1, sizeof (int));
+    writes_upto = (int *) calloc(total + 1, sizeof (int));
+    arg_registers = (unsigned int *) calloc(f->vreg_count + 1, sizeof (unsigned int));
+    prefer = (int *) malloc((f->vreg_count + 1) * sizeof (int));
+
+    for (v = 0; v < f->vreg_count; v++) {
+        start[v] = INT_MAX;
+        end[v] = -1;
+        prefer[v] = -1;
+    }
+    p = 0;
+    for (b = 0; b < f->block_count; b++) {
+        for (j = 0; j < f->blocks[b].count; j++, p++) {
+            Ir_inst * inst = &f->blocks[b].insts[j];
+            touch(start, end, inst->dst, p);
+            touch(start, end, inst->a, p);
+            touch(start, end, inst->b, p);
+            for (k = 0; k < inst->arg_count; k++)
+                touch(start, end, inst->args[k], p);
+            calls_upto[p] = (p > 0 ? calls_upto[p - 1] : 0) + (inst->op == IR_CALL);
+            writes_upto[p] = (p > 0 ? writes_upto[p - 1] : 0)
+                + (inst->op == IR_WRITE || inst->op == IR_WRITELN || inst->op == IR_READ);
+            if (inst->op == IR_PARAM && inst->imm < 4) {
+                param_position[inst->imm] = p;
+                prefer[inst->dst] = a0 + inst->imm;
+            }
+            if (inst->op == IR_STORE && inst->sym >= 0 && is_large_global(inst->sym))
+                global_store = 1;
+        }
+    }
+    extend_over_loops(f, block_start, start, end);
+    p = 0;
+    for (b = 0; b < f->block_count; b++) {
+        for (j = 0; j < f->blocks[b].count; j++, p++) {
+            Ir_inst * inst = &f->blocks[b].insts[j];
+            if (inst->op != IR_CALL) continue;
+            for (k = 0; k < inst->arg_count && k < 4; k++) {
+                v = inst->args[k];
+                if (end[v] != p) continue;
+                arg_registers[v] |= REG_BIT(a0 + k);
+                prefer[v] = a0 + k;
+            }
+        }
+    }
+
+    interval_count = 0;
+    for (v = 0; v < f->vreg_count; v++) {
+        Interval * interval;
+        unsigned int allowed = ~0u;
+        if (end[v] < 0) continue;
+        // calls move their arguments into $a0-$a3 and clobber them; a value
+        // that dies as an argument of the only call it meets may already be
+        // computed into that argument's register
+        if (calls_upto[end[v]] - calls_upto[start[v]] > 0) {
+            if (calls_upto[end[v] - 1] - calls_upto[start[v]] == 0 && arg_registers[v] != 0
+                    && (arg_registers[v] & (arg_registers[v] - 1)) == 0)
+                allowed &= ~A_REGISTERS | arg_registers[v];
+            else
+                allowed &= ~A_REGISTERS;
+        }
+        if (end[v] > start[v] && writes_upto[end[v] - 1] - writes_upto[start[v]] > 0)
+            allowed &= ~REG_BIT(a0);
+        for (k = 0; k < 4; k++)
+            if (start[v] < param_position[k])
+                allowed &= ~REG_BIT(a0 + k);
+        interval = &intervals[interval_count++];
+        interval->vreg = v;
+        interval->start = start[v];
+        interval->end = end[v];
+        interval->allowed = allowed;
+        interval->prefer = prefer[v];
+    }
+    qsort(intervals, interval_count, sizeof (Interval), compare_start);
+
+    free(block_start);
+    free(calls_upto);
+    free(writes_upto);
+    free(arg_registers);
+    free(prefer);
+    return global_store;
+}
+
+/**
+ * Runs linear scan with the given registers held back.
+ * @return: number of spilled intervals
+ */
+static int linear_scan(Allocation * result, unsigned int reserved) {
+    int active[POOL_SIZE];
+    int active_count = 0;
+    unsigned int free_registers = 0;
+    int spills = 0;
+    int i, k;
+
+    for (k = 0; k < POOL_SIZE; k++)
+        free_registers |= REG_BIT(pool[k]);
+    free_registers &= ~reserved;
+    result->used = 0;
+
+    for (i = 0; i < interval_count; i++) {
+        Interval * current = &intervals[i];
+        unsigned int candidates;
+        int victim = -1;
+
+        // operands dying here may hand their register to the result
+        for (k = 0; k < active_count; k++) {
+            Interval * old = &intervals[active[k]];
+            if (old->end <= current->start) {
+                free_registers |= REG_BIT(result->reg[old->vreg]);
+                active[k--] = active[--active_count];
+            }
+        }
+
+        candidates = free_registers & current->allowed;
+        if (candidates != 0) {
+            for (k = 0; !(candidates & REG_BIT(pool[k])); k++)
+                ;
+            if (current->prefer >= 0 && (candidates & REG_BIT(current->prefer)))
+                for (k = 0; pool[k] != current->prefer; k++)
+                    ;
+            result->reg[current->vreg] = pool[k];
+            free_registers &= ~REG_BIT(pool[k]);
+            active[active_count++] = i;
+            continue;
+        }
+
+        // no register: spill whichever usable interval ends last
+        for (k = 0; k < active_count; k++) {
+            Interval * other = &intervals[active[k]];
+            if (!(current->allowed & REG_BIT(result->reg[other->vreg]))) continue;
+            if (victim < 0 || other->end > intervals[active[victim]].end) victim = k;
+        }
+        if (victim >= 0 && intervals[active[victim]].end > current->end) {
+            Interval * other = &intervals[active[victim]];
+            result->reg[current->vreg] = result->reg[other->vreg];
+            result->reg[other->vreg] = -1;
+            active[victim] = i;
+        } else {
+            result->reg[current->vreg] = -1;
+        }
+        spills++;
+    }
+    for (i = 0; i < interval_count; i++)
+        if (result->reg[intervals[i].vreg] >= 0)
+            result->used |= REG_BIT(result->reg[intervals[i].vreg]);
+    return spills;
+}
+
+/**
+ * Gives every spilled interval a slot, reusing slots of finished ones.
+ */
+static void assign_spill_slots(Allocation * result) {
+    int * slot_end = (int *) malloc((interval_count + 1) * sizeof (int));
+    int i, k;
+
+    result->spill_slot_count = 0;
+    for (i = 0; i < interval_count; i++) {
+        Interval * interval = &intervals[i];
+        if (result->reg[interval->vreg] >= 0) continue;
+        for (k = 0; k < result->spill_slot_count && slot_end[k] >= interval->start; k++)
+            ;
+        if (k == result->spill_slot_count) result->spill_slot_count++;
+        slot_end[k] = interval->end;
+        result->spill_slot[interval->vreg] = k;
+    }
+    free(slot_end);
+}
+
+void regalloc_function(Ir_function * f, Allocation * result) {
+    int size = f->vreg_count + 1;
+    unsigned int reserved = 0;
+    int i;
+
+    result->reg = (int *) malloc(size * sizeof (int));
+    result->spill_slot = (int *) malloc(size * sizeof (int));
+    result->start = (int *) malloc(size * sizeof (int));
+    result->end = (int *) malloc(size * sizeof (int));
+    for (i = 0; i < size; i++)
+        result->reg[i] = result->spill_slot[i] = -1;
+    result->scratch[0] = result->scratch[1] = -1;
+
+    intervals = (Interval *) malloc(size * sizeof (Interval));
+    if (build_intervals(f, result->start, result->end)) {
+        reserved = REG_BIT(t9);
+        result->scratch[1] = t9;
+    }
+    result->spill_count = linear_scan(result, reserved);
+    if (result->spill_count > 0) {
+        // spilled operands are reloaded into the scratch registers
+        result->scratch[0] = t8;
+        result->scratch[1] = t9;
+        result->spill_count = linear_scan(result, REG_BIT(t8) | REG_BIT(t9));
+    }
+    assign_spill_slots(result);
+
+    free(intervals);
+    intervals = NULL;
+    interval_count = 0;
+}
+
+void regalloc_free(Allocation * result) {
+    free(result->reg);
+    free(result->spill_slot);
+    free(result->start);
+    free(result->end);
+    result->reg = result->spill_slot = NULL;
+    result->start = result->end = NULL;
+}
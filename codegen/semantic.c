@@ -0,0 +1,472 @@
+// semantic analysis of the AST: name resolution and type annotation
+//
+// walks the tree once with the scoped symbol table, gives every declared
+// name a Symbol, records the Symbol on each use and the type of every
+// expression, and reports all semantic errors instead of stopping at the
+// first one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "parser.h"
+#include "lexer.h"
+#include "semantic.h"
+
+static Symbol * symbols = NULL;
+static int symbols_count = 0;
+static int symbols_max = 0;
+
+static FunDef * functions = NULL;
+static int functions_count = 0;
+static int functions_max = 0;
+
+static int globals_count = 0;
+static int current_function = -1;
+static int scope_count = 0;         // blocks numbered so far, in preorder
+static int current_scope = -1;      // number of the innermost block
+static int error_count = 0;
+
+static void check_node(ast_node * node);
+
+static void semantic_error(const char * msg, int line) {
+    fprintf(stderr, "Line %d: %s\n", line + 1, msg);
+    error_count++;
+}
+
+static VARTYPE type_of(ast_node * type_node) {
+    return (type_node->symbol->token == INT) ? T_INT : T_CHAR;
+}
+
+static void set_type(ast_node * node, VARTYPE type) {
+    node->symbol->type = type;
+}
+
+/**
+ * @return: index of the new symbol
+ */
+static int new_symbol(const char * name, SYMKIND kind, VARTYPE type, STORAGE storage, int count, int line) {
+    Symbol * symbol;
+
+    if (symbols_count >= symbols_max) {
+        symbols_max = symbols_max > 0 ? symbols_max * 2 : 64;
+        symbols = (Symbol *) realloc(symbols, symbols_max * sizeof (Symbol));
+    }
+    symbol = &symbols[symbols_count];
+    symbol->name = name;
+    symbol->kind = kind;
+    symbol->type = type;
+    symbol->storage = storage;
+    symbol->count = count;
+    symbol->function = current_function;
+    symbol->param_index = -1;
+    symbol->scope = (storage == STORAGE_LOCAL) ? current_scope : -1;
+    symbol->scope_end = symbol->scope;
+    symbol->line_no = line;
+    if (storage == STORAGE_GLOBAL)
+        symbol->slot = globals_count++;
+    else if (storage == STORAGE_FUNCTION)
+        symbol->slot = -1;
+    else
+        symbol->slot = functions[current_function].slot_count++;
+    return symbols_count++;
+}
+
+/**
+ * Declares a variable or array in the innermost scope.
+ * A second declaration of a name in the same scope gets its own storage,
+ * but the first one stays visible.
+ */
+static int declare(ast_node * id_node, SYMKIND kind, VARTYPE type, STORAGE storage, int count) {
+    int index = new_symbol(id_node->symbol->lexeme, kind, type, storage, count, id_node->symbol->line_no);
+
+    symtab_insert(kind, id_node->symbol->lexeme, index);
+    id_node->symbol->sym = index;
+    return index;
+}
+
+static void check_var_decl(ast_node * node, STORAGE storage) {
+    ast_node ** args = get_childlist(node);
+
+    if (get_num_children(node) == 2)
+        declare(args[1], SYM_VARIABLE, type_of(args[0]), storage, 1);
+    else
+        declare(args[1], SYM_ARRAY, type_of(args[0]), storage, args[2]->symbol->value);
+}
+
+static void check_param_decl(ast_node * node, int param_index) {
+    ast_node ** args = get_childlist(node);
+    FunDef * fun = &functions[current_function];
+    int index;
+
+    if (get_num_children(node) == 2)
+        index = declare(args[1], SYM_VARIABLE, type_of(args[0]), STORAGE_PARAM, 1);
+    else
+        index = declare(args[1], SYM_ARRAY, type_of(args[0]), STORAGE_PARAM, 0);
+    symbols[index].param_index = param_index;
+
+    if (fun->param_count >= fun->param_max) {
+        fun->param_max = fun->param_max > 0 ? fun->param_max * 2 : 4;
+        fun->params = (int *) realloc(fun->params, fun->param_max * sizeof (int));
+    }
+    fun->params[fun->param_count++] = index;
+}
+
+/**
+ * Resolves an ID used as a scalar, or as an array element when it has an
+ * index child.
+ */
+static void check_lvalue_id(ast_node * node) {
+    ast_info * info = node->symbol;
+    int index;
+
+    if (get_num_children(node) == 0) {
+        index = symtab_lookup(SYM_VARIABLE, info->lexeme);
+        if (index < 0) {
+            semantic_error("error: variable undeclared (first use in this function)", info->line_no);
+            return;
+        }
+    } else {
+        index = symtab_lookup(SYM_ARRAY, info->lexeme);
+        if (index < 0)
+            semantic_error("error: array undeclared (first use in this function)", info->line_no);
+        check_node(get_childlist(node)[0]);
+        if (index < 0) return;
+    }
+    info->sym = index;
+    set_type(node, symbols[index].type);
+}
+
+static void check_call(ast_node * node) {
+    ast_info * info = node->symbol;
+    ast_node * expr_list = get_childlist(node)[0];
+    ast_node ** args = get_childlist(expr_list);
+    int num_args = get_num_children(expr_list);
+    int index = symtab_lookup(SYM_FUNCTION, info->lexeme);
+    FunDef * fun;
+    Symbol * param;
+    int i;
+
+    if (index < 0) {
+        semantic_error("error: function not declared.", info->line_no);
+        for (i = 0; i < num_args; i++)
+            check_node(args[i]);
+        return;
+    }
+    info->sym = functions[index].symbol;
+    set_type(node, functions[index].type);
+    fun = &functions[index];
+
+    if (num_args < fun->param_count) semantic_error("error: too few arguments to function", info->line_no);
+    if (num_args > fun->param_count) semantic_error("error: too many arguments to function", info->line_no);
+
+    for (i = 0; i < num_args; i++) {
+        ast_info * arg = args[i]->symbol;
+        int sym = -1;
+
+        // a bare name passed as an argument may also denote a whole array
+        if (arg->token == ID && get_num_children(args[i]) == 0) {
+            sym = symtab_lookup(SYM_VARIABLE, arg->lexeme);
+            if (sym < 0) sym = symtab_lookup(SYM_ARRAY, arg->lexeme);
+        }
+        if (sym < 0) {
+            check_node(args[i]);
+        } else {
+            arg->sym = sym;
+            set_type(args[i], symbols[sym].type);
+        }
+        if (i >= fun->param_count) continue;
+
+        param = &symbols[fun->params[i]];
+        if (sym >= 0) {
+            if (symbols[sym].type != param->type || symbols[sym].kind != param->kind)
+                semantic_error("error: non-matching argument types", info->line_no);
+        } else if (param->kind == SYM_ARRAY) {
+            semantic_error("error: non-matching argument types", info->line_no);
+        }
+    }
+}
+
+static void check_id(ast_node * node) {
+    if (is_call_node(node))
+        check_call(node);
+    else
+        check_lvalue_id(node);
+}
+
+static void check_assign(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+
+    if (args[0]->symbol->token != ID) {
+        semantic_error("error: incompatible lvalue.", args[0]->symbol->line_no);
+        check_node(args[0]);
+    } else {
+        check_lvalue_id(args[0]);
+    }
+    check_node(args[1]);
+    node->symbol->type = args[0]->symbol->type;
+}
+
+static void check_read(ast_node * node) {
+    ast_node * arg = get_childlist(node)[0];
+
+    if (arg->symbol->token != ID) {
+        semantic_error("error: incompatible rvalue.", arg->symbol->line_no);
+        return;
+    }
+    check_lvalue_id(arg);
+}
+
+static void check_block(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    ast_node ** decls = get_childlist(args[0]);
+    int parent = current_scope;
+    int first = symbols_count;
+    int last;
+    int i;
+
+    symtab_push_scope();
+    current_scope = scope_count++;
+    for (i = 0; i < get_num_children(args[0]); i++)
+        check_var_decl(decls[i], STORAGE_LOCAL);
+    last = symbols_count;
+    check_node(args[1]);
+    // the locals of this block live as long as any block nested in it
+    for (i = first; i < last; i++)
+        symbols[i].scope_end = scope_count - 1;
+    current_scope = parent;
+    symtab_pop_scope();
+}
+
+static int is_expr(ast_node * node) {
+    switch (node->symbol->token) {
+        case ID:
+        case NUM:
+        case ASSIGN:
+        case PLUS:
+        case MINUS:
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case NEG:
+        case EQU:
+        case NEQ:
+        case LSS:
+        case LEQ:
+        case GTR:
+        case GEQ:
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * The parser leaves an operand or a condition it could not parse out of
+ * the tree, so the node has fewer children than its token takes, or the
+ * arm of an if or while takes the place of the condition.
+ * @return: 1 if node has all the expressions its token takes
+ */
+static int has_operands(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int num_args = get_num_children(node);
+    int expected, i;
+
+    switch (node->symbol->token) {
+        case ASSIGN:
+        case PLUS:
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case EQU:
+        case NEQ:
+        case LSS:
+        case LEQ:
+        case GTR:
+        case GEQ:
+            expected = 2;
+            break;
+        case MINUS:
+            expected = num_args == 2 ? 2 : 1;
+            break;
+        case NEG:
+        case WRITE:
+        case RETURN:
+            expected = 1;
+            break;
+        case IF:
+        case WHILE:
+            // only the condition, the arms are statements
+            return num_args > 0 && is_expr(args[0]);
+        default:
+            return 1;
+    }
+    if (num_args != expected) return 0;
+    for (i = 0; i < num_args; i++)
+        if (!is_expr(args[i])) return 0;
+    return 1;
+}
+
+/**
+ * Checks statements and expressions; operators always produce an int.
+ */
+static void check_node(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    int i;
+
+    if (node->symbol->token == NONTERMINAL && node->symbol->grammar_symbol == BLOCK_N) {
+        check_block(node);
+        return;
+    }
+    if (!has_operands(node)) {
+        semantic_error("error: expected expression.", node->symbol->line_no);
+        return;
+    }
+    switch (node->symbol->token) {
+        case ID:
+            check_id(node);
+            return;
+        case ASSIGN:
+            check_assign(node);
+            return;
+        case READ:
+            check_read(node);
+            return;
+        case NUM:
+            set_type(node, T_INT);
+            return;
+        case PLUS:
+        case MINUS:
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case NEG:
+        case EQU:
+        case NEQ:
+        case LSS:
+        case LEQ:
+        case GTR:
+        case GEQ:
+            set_type(node, T_INT);
+            break;
+    }
+    for (i = 0; i < get_num_children(node); i++)
+        check_node(args[i]);
+}
+
+static void check_fun_decl(ast_node * node) {
+    ast_node ** args = get_childlist(node);
+    ast_node ** params;
+    ast_node * id_node;
+    FunDef * fun;
+    int i;
+
+    if (get_num_children(node) != 4) {
+        // the parser leaves out the type node of a function without one
+        semantic_error("error: function return type missing.", node->symbol->line_no);
+        return;
+    }
+    id_node = args[1];
+    if (symtab_lookup(SYM_FUNCTION, id_node->symbol->lexeme) >= 0) {
+        semantic_error("error: function already defined.", node->symbol->line_no);
+        return;
+    }
+
+    if (functions_count >= functions_max) {
+        functions_max = functions_max > 0 ? functions_max * 2 : 16;
+        functions = (FunDef *) realloc(functions, functions_max * sizeof (FunDef));
+    }
+    current_function = functions_count++;
+    fun = &functions[current_function];
+    fun->name = id_node->symbol->lexeme;
+    fun->type = type_of(args[0]);
+    fun->params = NULL;
+    fun->param_count = 0;
+    fun->param_max = 0;
+    fun->slot_count = 0;
+    fun->node = node;
+    fun->symbol = new_symbol(fun->name, SYM_FUNCTION, fun->type, STORAGE_FUNCTION, 0, id_node->symbol->line_no);
+    symbols[fun->symbol].function = current_function;
+    id_node->symbol->sym = fun->symbol;
+    node->symbol->sym = fun->symbol;
+    // bound before the body is checked so that recursive calls resolve
+    symtab_insert_global(SYM_FUNCTION, fun->name, current_function);
+
+    symtab_push_scope(); // a scope for parameters
+    params = get_childlist(args[2]);
+    // the parser builds the parameter list back to front
+    for (i = get_num_children(args[2]) - 1; i >= 0; i--)
+        check_param_decl(params[i], functions[current_function].param_count);
+    check_block(args[3]);
+    symtab_pop_scope();
+    current_function = -1;
+}
+
+int semantic_analysis(ast_node * root) {
+    ast_node ** args = get_childlist(root);
+    int num_children = get_num_children(root);
+    int i;
+
+    semantic_destroy();
+    symtab_init();
+    symtab_push_scope(); // globals
+
+    // globals are stored back to front after the function list
+    for (i = num_children - 1; i > 0; i--) {
+        if (args[i]->symbol->grammar_symbol == VAR_DECL)
+            check_var_decl(args[i], STORAGE_GLOBAL);
+    }
+    if (num_children > 0) {
+        ast_node ** funs = get_childlist(args[0]);
+        for (i = 0; i < get_num_children(args[0]); i++)
+            check_fun_decl(funs[i]);
+    }
+
+    symtab_pop_scope();
+    symtab_destroy();
+    return error_count;
+}
+
+void semantic_destroy() {
+    int i;
+
+    for (i = 0; i < functions_count; i++)
+        free(functions[i].params);
+    free(functions);
+    free(symbols);
+    functions = NULL;
+    symbols = NULL;
+    functions_count = functions_max = 0;
+    symbols_count = symbols_max = 0;
+    globals_count = 0;
+    error_count = 0;
+    scope_count = 0;
+    current_scope = -1;
+    current_function = -1;
+}
+
+Symbol * get_symbol(int index) {
+    return &symbols[index];
+}
+
+int get_symbol_count() {
+    return symbols_count;
+}
+
+FunDef * get_function(int index) {
+    return &functions[index];
+}
+
+int get_function_count() {
+    return functions_count;
+}
+
+int get_global_count() {
+    return globals_count;
+}
+
+int is_call_node(ast_node * node) {
+    return node->symbol->token == ID && get_num_children(node) == 1
+        && get_childlist(node)[0]->symbol->token == NONTERMINAL
+        && get_childlist(node)[0]->symbol->grammar_symbol == EXPR_LIST;
+}
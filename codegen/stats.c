@@ -0,0 +1,98 @@
+// per-function counters for --stats
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+typedef struct {
+    const char * function;  // not owned, must outlive the table
+    int * values;           // indexed like counters
+} Stats_row;
+
+static const char ** counters = NULL;
+static int counter_count = 0;
+static int counter_max = 0;
+
+static Stats_row * rows = NULL;
+static int row_count = 0;
+static int row_max = 0;
+
+static int find_counter(const char * counter) {
+    int i;
+
+    for (i = 0; i < counter_count; i++)
+        if (!strcmp(counters[i], counter)) return i;
+    if (counter_count >= counter_max) {
+        counter_max = counter_max > 0 ? counter_max * 2 : 8;
+        counters = (const char **) realloc(counters, counter_max * sizeof (const char *));
+        for (i = 0; i < row_count; i++)
+            rows[i].values = (int *) realloc(rows[i].values, counter_max * sizeof (int));
+    }
+    for (i = 0; i < row_count; i++)
+        rows[i].values[counter_count] = 0;
+    counters[counter_count] = counter;
+    return counter_count++;
+}
+
+static Stats_row * find_row(const char * function) {
+    int i;
+
+    for (i = 0; i < row_count; i++)
+        if (!strcmp(rows[i].function, function)) return &rows[i];
+    if (row_count >= row_max) {
+        row_max = row_max > 0 ? row_max * 2 : 16;
+        rows = (Stats_row *) realloc(rows, row_max * sizeof (Stats_row));
+    }
+    rows[row_count].function = function;
+    rows[row_count].values = (int *) calloc(counter_max > 0 ? counter_max : 1, sizeof (int));
+    return &rows[row_count++];
+}
+
+void stats_add(const char * function, const char * counter, int value) {
+    int index = find_counter(counter);
+    find_row(function)->values[index] += value;
+}
+
+int stats_get(const char * function, const char * counter) {
+    int i, j;
+
+    for (i = 0; i < row_count; i++) {
+        if (strcmp(rows[i].function, function)) continue;
+        for (j = 0; j < counter_count; j++)
+            if (!strcmp(counters[j], counter)) return rows[i].values[j];
+    }
+    return 0;
+}
+
+void stats_dump(FILE * out) {
+    int i, j, total;
+
+    for (i = 0; i < row_count; i++) {
+        fprintf(out, "# stats %s:", rows[i].function);
+        for (j = 0; j < counter_count; j++)
+            fprintf(out, "%s %s %d", j > 0 ? "," : "", counters[j], rows[i].values[j]);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "# stats total:");
+    for (j = 0; j < counter_count; j++) {
+        total = 0;
+        for (i = 0; i < row_count; i++)
+            total += rows[i].values[j];
+        fprintf(out, "%s %s %d", j > 0 ? "," : "", counters[j], total);
+    }
+    fprintf(out, "\n");
+}
+
+void stats_destroy() {
+    int i;
+
+    for (i = 0; i < row_count; i++)
+        free(rows[i].values);
+    free(rows);
+    free(counters);
+    rows = NULL;
+    counters = NULL;
+    row_count = row_max = 0;
+    counter_count = counter_max = 0;
+}
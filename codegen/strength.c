@@ -0,0 +1,126 @@
+// plans for multiplying and dividing by a constant with shifts, adds and
+// a multiply-high instead of mul and div
+
+#include <stdio.h>
+#include "strength.h"
+
+static unsigned int magnitude(int c) {
+    return c < 0 ? 0u - (unsigned int) c : (unsigned int) c;
+}
+
+static int add_step(Step * steps, int count, Step_op op, int imm) {
+    steps[count].op = op;
+    steps[count].imm = imm;
+    return count + 1;
+}
+
+/**
+ * Writes |c| in non-adjacent form, digits -1, 0 and 1 with no two
+ * adjacent digits set, which has the fewest digits set.
+ * @return: number of digits, least significant first in digits
+ */
+static int non_adjacent_form(unsigned int m, int * digits) {
+    int count = 0;
+
+    while (m != 0) {
+        int digit = 0;
+        if (m & 1) {
+            digit = (m & 3) == 1 ? 1 : -1;
+            m -= (unsigned int) digit;
+        }
+        digits[count++] = digit;
+        m >>= 1;
+    }
+    return count;
+}
+
+/**
+ * The product is worked out Horner style from the top digit down: shift
+ * up to the next digit set, then add or subtract x.
+ */
+int plan_multiply(int c, Step * steps) {
+    int digits[34];
+    int count = 0;
+    int top, previous, i;
+
+    if (c == 0) return -1;
+    top = non_adjacent_form(magnitude(c), digits) - 1;
+    previous = top;
+    for (i = top - 1; i >= 0; i--) {
+        if (digits[i] == 0) continue;
+        count = add_step(steps, count, STEP_SLL, previous - i);
+        count = add_step(steps, count, digits[i] > 0 ? STEP_ADD_X : STEP_SUB_X, 0);
+        previous = i;
+    }
+    if (previous > 0) count = add_step(steps, count, STEP_SLL, previous);
+    if (c < 0) count = add_step(steps, count, STEP_NEG, 0);
+    return count < 1 + MULTIPLY_COST ? count : -1;
+}
+
+/**
+ * Finds the magic number of d, |d| >= 2 and not a power of two, as in
+ * Hacker's Delight 10-1: the high word of magic * x, shifted right by
+ * shift, is x / d rounded down.
+ */
+static void divide_magic(int d, int * magic, int * shift) {
+    const unsigned int two31 = 0x80000000u;
+    unsigned int ad = magnitude(d);
+    unsigned int t = two31 + ((unsigned int) d >> 31);
+    unsigned int anc = t - 1 - t % ad;
+    unsigned int q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned int q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned int delta;
+    int p = 31;
+
+    do {
+        p++;
+        q1 = 2 * q1;
+        r1 = 2 * r1;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 = 2 * q2;
+        r2 = 2 * r2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    *magic = (int) (q2 + 1);
+    if (d < 0) *magic = (int) (0u - (q2 + 1));
+    *shift = p - 32;
+}
+
+/**
+ * A quotient rounded down is one less than the quotient rounded towards
+ * zero when it is negative, so both plans end by adding its sign bit.
+ */
+int plan_divide(int d, Step * steps) {
+    unsigned int m = magnitude(d);
+    int count = 0;
+    int magic, shift, k;
+
+    if (d == 0) return -1;
+    if ((m & (m - 1)) == 0) {
+        for (k = 0; (1u << k) != m; k++)
+            ;
+        if (k > 0) {
+            // x + 2^k - 1 when x is negative, then shift
+            if (k > 1) count = add_step(steps, count, STEP_SRA, 31);
+            count = add_step(steps, count, STEP_SRL, 32 - k);
+            count = add_step(steps, count, STEP_ADD_X, 0);
+            count = add_step(steps, count, STEP_SRA, k);
+        }
+        if (d < 0) count = add_step(steps, count, STEP_NEG, 0);
+        return count;
+    }
+    divide_magic(d, &magic, &shift);
+    count = add_step(steps, count, STEP_MULHI, magic);
+    if (d > 0 && magic < 0) count = add_step(steps, count, STEP_ADD_X, 0);
+    if (d < 0 && magic > 0) count = add_step(steps, count, STEP_SUB_X, 0);
+    if (shift > 0) count = add_step(steps, count, STEP_SRA, shift);
+    count = add_step(steps, count, STEP_ADD_SIGN, 0);
+    return count;
+}
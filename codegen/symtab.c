@@ -0,0 +1,234 @@
+// scoped symbol table built on one open-addressing hash map
+//
+// every (kind, name) key has at most one slot holding its innermost
+// binding.  inserting into a scope that shadows an outer binding records
+// the old binding in an undo log; popping a scope replays the log back to
+// the mark taken when the scope was pushed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+
+#define SYMTAB_INITIAL_CAPACITY 64
+
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_USED,
+    SLOT_DELETED
+} Slot_state;
+
+typedef struct {
+    const char * name;
+    SYMKIND kind;
+    int value;
+    int depth;
+    unsigned int hash;
+    Slot_state state;
+} Symslot;
+
+typedef struct {
+    const char * name;
+    SYMKIND kind;
+    int had_binding;    // 0 if the key was unbound before the insert
+    int value;
+    int depth;
+} Undo_entry;
+
+static Symslot * slots = NULL;
+static int slots_capacity = 0;
+static int slots_used = 0;
+static int slots_deleted = 0;
+
+static Undo_entry * undo_log = NULL;
+static int undo_count = 0;
+static int undo_max = 0;
+
+static int * scope_marks = NULL;    // undo_count when each scope was pushed
+static int scope_depth = 0;
+static int scope_max = 0;
+
+static unsigned int hash_key(SYMKIND kind, const char * name) {
+    unsigned int h = 2166136261u;   // FNV-1a
+    while (*name) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+    h ^= (unsigned int) kind;
+    h *= 16777619u;
+    return h;
+}
+
+/*
+ * returns: the slot holding the key, or -1 if the key is not in the table
+ */
+static int find_slot(SYMKIND kind, const char * name, unsigned int hash) {
+    int mask = slots_capacity - 1;
+    int i = hash & mask;
+
+    while (slots[i].state != SLOT_EMPTY) {
+        if (slots[i].state == SLOT_USED && slots[i].hash == hash
+                && slots[i].kind == kind && !strcmp(slots[i].name, name))
+            return i;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+/*
+ * returns: the first free (empty or deleted) slot on the key's probe chain
+ */
+static int find_free_slot(unsigned int hash) {
+    int mask = slots_capacity - 1;
+    int i = hash & mask;
+
+    while (slots[i].state == SLOT_USED)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void rehash(int new_capacity) {
+    Symslot * old = slots;
+    int old_capacity = slots_capacity;
+    int i;
+
+    slots = (Symslot *) calloc(new_capacity, sizeof (Symslot));
+    slots_capacity = new_capacity;
+    slots_used = 0;
+    slots_deleted = 0;
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i].state == SLOT_USED) {
+            slots[find_free_slot(old[i].hash)] = old[i];
+            slots_used++;
+        }
+    }
+    free(old);
+}
+
+static void grow_if_needed() {
+    // deleted slots still lengthen probe chains, so they count as load
+    if ((slots_used + slots_deleted + 1) * 2 > slots_capacity) {
+        if ((slots_used + 1) * 4 > slots_capacity)
+            rehash(slots_capacity * 2);
+        else
+            rehash(slots_capacity);
+    }
+}
+
+static void push_undo(SYMKIND kind, const char * name, Symslot * old) {
+    Undo_entry * entry;
+
+    if (undo_count >= undo_max) {
+        undo_max = undo_max > 0 ? undo_max * 2 : 64;
+        undo_log = (Undo_entry *) realloc(undo_log, undo_max * sizeof (Undo_entry));
+    }
+    entry = &undo_log[undo_count++];
+    entry->name = name;
+    entry->kind = kind;
+    entry->had_binding = (old != NULL);
+    entry->value = old ? old->value : -1;
+    entry->depth = old ? old->depth : -1;
+}
+
+void symtab_init() {
+    symtab_destroy();
+    slots = (Symslot *) calloc(SYMTAB_INITIAL_CAPACITY, sizeof (Symslot));
+    slots_capacity = SYMTAB_INITIAL_CAPACITY;
+}
+
+void symtab_destroy() {
+    free(slots);
+    free(undo_log);
+    free(scope_marks);
+    slots = NULL;
+    undo_log = NULL;
+    scope_marks = NULL;
+    slots_capacity = slots_used = slots_deleted = 0;
+    undo_count = undo_max = 0;
+    scope_depth = scope_max = 0;
+}
+
+void symtab_push_scope() {
+    if (scope_depth >= scope_max) {
+        scope_max = scope_max > 0 ? scope_max * 2 : 16;
+        scope_marks = (int *) realloc(scope_marks, scope_max * sizeof (int));
+    }
+    scope_marks[scope_depth++] = undo_count;
+}
+
+void symtab_pop_scope() {
+    Undo_entry * entry;
+    int i;
+
+    if (scope_depth == 0) return;
+    scope_depth--;
+    while (undo_count > scope_marks[scope_depth]) {
+        entry = &undo_log[--undo_count];
+        i = find_slot(entry->kind, entry->name, hash_key(entry->kind, entry->name));
+        if (i < 0) continue; // cannot happen: every logged key is bound
+        if (entry->had_binding) {
+            slots[i].value = entry->value;
+            slots[i].depth = entry->depth;
+        } else {
+            slots[i].state = SLOT_DELETED;
+            slots_used--;
+            slots_deleted++;
+        }
+    }
+}
+
+int symtab_scope_depth() {
+    return scope_depth;
+}
+
+int symtab_insert(SYMKIND kind, const char * name, int value) {
+    unsigned int hash = hash_key(kind, name);
+    int i;
+
+    grow_if_needed();
+    i = find_slot(kind, name, hash);
+    if (i >= 0) {
+        if (slots[i].depth == scope_depth) return -1;
+        push_undo(kind, name, &slots[i]);
+    } else {
+        push_undo(kind, name, NULL);
+        i = find_free_slot(hash);
+        if (slots[i].state == SLOT_DELETED) slots_deleted--;
+        slots[i].name = name;
+        slots[i].kind = kind;
+        slots[i].hash = hash;
+        slots[i].state = SLOT_USED;
+        slots_used++;
+    }
+    slots[i].value = value;
+    slots[i].depth = scope_depth;
+    return 0;
+}
+
+int symtab_insert_global(SYMKIND kind, const char * name, int value) {
+    unsigned int hash = hash_key(kind, name);
+    int i;
+
+    grow_if_needed();
+    if (find_slot(kind, name, hash) >= 0) return -1;
+    i = find_free_slot(hash);
+    if (slots[i].state == SLOT_DELETED) slots_deleted--;
+    slots[i].name = name;
+    slots[i].kind = kind;
+    slots[i].hash = hash;
+    slots[i].state = SLOT_USED;
+    slots[i].value = value;
+    slots[i].depth = 0;
+    slots_used++;
+    return 0;
+}
+
+int symtab_lookup(SYMKIND kind, const char * name) {
+    int i = find_slot(kind, name, hash_key(kind, name));
+    return (i < 0) ? -1 : slots[i].value;
+}
+
+int symtab_lookup_depth(SYMKIND kind, const char * name) {
+    int i = find_slot(kind, name, hash_key(kind, name));
+    return (i < 0) ? -1 : slots[i].depth;
+}
@@ -82,6 +82,8 @@ struct ast_info {
   char lexeme[MAX_LEXEME_SIZE];  // for ID tokens likely need to keep this  
   int grammar_symbol;  // some ast nodes may correspond to nonterminals
   int line_no;    // the source code line number associated with this token
+  int sym;        // Symbol the name resolves to, set by semantic analysis (-1 if none)
+  int type;       // VARTYPE of an expression, set by semantic analysis (-1 if none)
 };
 typedef struct ast_info ast_info;
 
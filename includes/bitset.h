@@ -0,0 +1,50 @@
+#ifndef _BITSET_H
+#define _BITSET_H
+
+// dense bitsets of a fixed number of bits, stored as arrays of words
+//
+// a Bitset does not know its size: every operation takes the number of
+// words, see bitset_words().  bits past the size are kept clear.
+
+typedef unsigned int * Bitset;
+
+#define BITSET_WORD_BITS 32
+
+int bitset_words(int bits);
+
+/*
+ * returns: a new bitset of the given number of words, all clear
+ */
+Bitset bitset_new(int words);
+void bitset_free(Bitset set);
+
+void bitset_set(Bitset set, int bit);
+void bitset_clear(Bitset set, int bit);
+int bitset_test(Bitset set, int bit);
+
+void bitset_fill(Bitset set, int bits);    // sets bits 0 .. bits-1
+void bitset_zero(Bitset set, int words);
+void bitset_copy(Bitset to, Bitset from, int words);
+
+/*
+ * to |= from, to &= from
+ * returns: 1 if to changed
+ */
+int bitset_union(Bitset to, Bitset from, int words);
+int bitset_intersect(Bitset to, Bitset from, int words);
+
+/*
+ * to = gen | (from & ~kill), the transfer function of bit-vector problems
+ * returns: 1 if to changed
+ */
+int bitset_transfer(Bitset to, Bitset gen, Bitset from, Bitset kill, int words);
+
+int bitset_equal(Bitset a, Bitset b, int words);
+int bitset_count(Bitset set, int words);
+
+/*
+ * returns: lowest set bit at or after start, -1 if there is none
+ */
+int bitset_next(Bitset set, int start, int words);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _CALLGRAPH_H
+#define _CALLGRAPH_H
+
+// whole-program call graph built from the annotated AST
+//
+// functions are identified by their index in the semantic function table
+// (see get_function()).  every ID node with an EXPR_LIST child is a call
+// site.  strongly connected components are found with Tarjan's algorithm,
+// which produces them callees first, so they double as a bottom-up order.
+
+#include <stdio.h>
+#include "semantic.h"
+
+typedef struct {
+    int * callees;      // distinct functions called, in order of first call
+    int callee_count;
+    int callee_max;
+    int call_sites;     // call expressions in the body of the function
+    int callers;        // call expressions anywhere that call the function
+    int scc;            // index of the component, components are bottom-up
+    int does_io;        // reads or writes, which calls the output runtime
+    int is_leaf;        // makes no calls at all, not even to the runtime
+    int is_recursive;   // calls itself, directly or through its component
+} CallNode;
+
+/*
+ * builds the call graph; semantic_analysis() must have succeeded
+ */
+void callgraph_build();
+void callgraph_destroy();
+
+CallNode * get_call_node(int fun);
+int get_scc_count();
+
+/*
+ * returns: function indices ordered so that every callee outside the
+ *          caller's component comes before the caller
+ */
+const int * get_bottom_up_order();
+
+void callgraph_dump(FILE * out);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _CFG_H
+#define _CFG_H
+
+// control-flow graph over the emitted codetable
+//
+// a basic block is a run of instructions [first, last] that is entered
+// only at first and left only after last.  blocks start at labels and
+// after branches, jumps and the return (jr $ra); a run of consecutive
+// labels shares one block.  calls (jal) return to the next instruction
+// and do not end a block.  edges never cross functions: the return has
+// no successor.
+//
+// blocks are numbered in instruction order, so the blocks of a function
+// are contiguous and its first block is its entry.
+
+#include <stdio.h>
+#include "codetable.h"
+
+typedef struct {
+    int first;          // index of the first instruction
+    int last;           // index of the last instruction
+    int function;       // index of the enclosing Cfg_function
+    int succ[2];        // fall-through successor first, then the branch target
+    int succ_count;
+    int * preds;
+    int pred_count;
+    int pred_max;
+} Cfg_block;
+
+typedef struct {
+    const char * name;  // NULL for code before the first function label
+    int entry;          // first block of the function
+    int block_count;
+    int exit;           // block ending in the return, -1 if there is none
+} Cfg_function;
+
+/*
+ * builds the CFG of the instructions currently in the codetable;
+ * any previous CFG is destroyed first
+ */
+void cfg_build();
+void cfg_destroy();
+
+int get_cfg_block_count();
+Cfg_block * get_cfg_block(int index);
+int get_cfg_function_count();
+Cfg_function * get_cfg_function(int index);
+
+/*
+ * returns: block holding the instruction
+ */
+int get_instruction_block(int index);
+
+/*
+ * returns: block that starts with the label, -1 if it is not defined
+ */
+int get_label_block(int label_id);
+
+/*
+ * returns: 1 for instructions that may transfer control to a label
+ */
+int is_branch(Instruction_line * l);
+
+/*
+ * returns: 1 for instructions after which control never falls through
+ */
+int ends_flow(Instruction_line * l);
+
+// graphviz, one cluster per function
+void cfg_dump(FILE * out);
+
+#endif
@@ -5,50 +5,28 @@
 // you likely will need to include other
 // header files from your compiler here
 #include "parser.h"
+#include "semantic.h"
 
 #define REGISTER_T_OFFSET 8
 #define REGISTER_COUNT 8
+#define ARG_REGISTER_COUNT 4    // arguments passed in $a0-$a3, the rest on the stack
 
 // add all definitions exported by your code gen modules here
-extern void codegen();
+void codegen(ast_node * root);
 
-int registers[REGISTER_COUNT];
+extern int registers[REGISTER_COUNT];
 void init_registers();
 void free_register(int reg);
 int allocate_register();
 
-typedef enum {
-    T_INT,
-    T_CHAR,
-    T_INTARR,
-    T_CHARARR
-} VARTYPE;
-
 typedef struct {
     int size;
     int offset;
     int count;
+    int indirect;   // an array parameter: the slot holds the address of element 0
+    const char * label; // a global: its static data, NULL for frame slots
 } VarAddress;
 
-typedef struct {
-    const char * name;
-    VARTYPE type;
-    VARTYPE param_type[4];
-    int is_array[4];
-    const char * param_name[4];
-    int param_count;
-
-} FunDef;
-
-typedef struct {
-    const char * name;
-    VARTYPE type;
-    int size;
-    int stack_height;
-    int is_array;
-    int count;
-} Symentry;
-
 typedef int (*handle_ptr)(ast_node *);
 handle_ptr get_handle_function(ast_node * node);
 
@@ -76,7 +54,7 @@ int handle_write(ast_node * node);
 int handle_writeln(ast_node * node);
 int handle_read(ast_node * node);
 void handle_stmt_list(ast_node * node);
-int handle_expr_list(ast_node * node, FunDef fun);
+int handle_expr_list(ast_node * node, FunDef * fun);
 void handle_var_decl_list(ast_node * node);
 void handle_var_decl(ast_node * node);
 void handle_param_decl_list(ast_node * node);
@@ -86,22 +64,23 @@ void handle_fun_decl(ast_node * node);
 void handle_fun_decl_list(ast_node * node);
 void handle_program(ast_node * node);
 int handle_assign(ast_node * node);
-int call_function(ast_node * node);
-void save_registers();
-void restore_registers();
-void handle_error(const char * msg, int line);
-void add_variable(VARTYPE type, const char * name);
-void add_array(VARTYPE type, const char * name, int arr_size, int zero_size);
+int call_function(ast_node * node, int dest_reg);
+int get_stack_argument_size(FunDef * fun);
+int save_registers(int dest_reg);
+void restore_registers(int saved);
+void init_symbol_heights();
+void add_global(int sym);
+void destroy_symbol_heights();
+void add_variable(int sym);
+void add_array(int sym);
 int get_padding();
 int get_scope_size();
-VarAddress lookup_variable(const char * name);
-VarAddress lookup_array(const char * name);
+VarAddress symbol_address(int sym);
 int destroy_scope(int verbose);
 void add_scope();
-FunDef define_function(VARTYPE type, const char * name);
-void add_parameter(VARTYPE type, int is_array, const char * name);
+void add_parameter(int sym);
 void set_current_function(FunDef * fun);
-FunDef lookup_function(const char* name);
+void set_function_entry_height(int height);
 void copy_parameters();
 void adjust_stack_height(int offset);
 int get_current_stack_height();
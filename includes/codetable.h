@@ -1,6 +1,34 @@
 #ifndef _CODETABLE_H
 #define _CODETABLE_H
 
+#include <stdio.h>
+
+#define SMALL_DATA_SIZE 8   // globals up to this size are addressed from $gp
+
+// signed 16-bit immediate of addi, slti and sltiu, and offset of a load or
+// store
+#define IMMEDIATE_MIN (-32768)
+#define IMMEDIATE_MAX 32767
+// unsigned 16-bit immediate of xori
+#define LOGICAL_IMMEDIATE_MAX 65535
+
+// output runtime, printed after the program: write and writeln append to a
+// buffer of OUT_BUFFER_SIZE bytes, printed with one print_string syscall
+// when it fills, before a read and when main returns.  the routines are
+// called with jal and change only $a0, $v0 and $ra
+#define OUT_BUFFER_SIZE 1024
+#define RUNTIME_WRITE_INT "_write_int"      // appends the decimal form of $a0
+#define RUNTIME_WRITELN "_write_newline"    // appends a newline
+#define RUNTIME_FLUSH "_out_flush"          // prints the buffer and empties it
+
+// input runtime, with --buffered-input: read takes its value from a buffer
+// of IN_BUFFER_SIZE bytes, refilled with one read syscall on standard input
+// when it runs dry; the output is flushed before each refill instead of
+// before each read.  same calling convention, the value comes back in $v0
+#define IN_BUFFER_SIZE 4096
+#define RUNTIME_READ_INT "_read_int"        // reads like syscall 5
+#define RUNTIME_READ_CHAR "_read_char"      // reads like syscall 12
+
 typedef enum {
     LI,
     LA,
@@ -29,8 +57,27 @@ typedef enum {
     BNEZ,
     SB,
     LB,
-    TEXT,
-    JAL
+    JR,
+    JAL,
+    BEQ,
+    BNE,
+    SLL,
+    SRA,
+    SRL,
+    MULT_I,
+    MFHI,
+    SLTI,
+    SLTIU,
+    SLTU,
+    XORI,
+    BLT,
+    BGT,
+    BLTZ,
+    BGEZ,
+    BLEZ,
+    BGTZ,
+    ADDU,
+    SUBU
 } Instruction_type;
 
 extern const char * instruction_type_string[];
@@ -44,9 +91,8 @@ typedef enum {
     LABEL_WHILE_END,
     LABEL_COMPARE,
     LABEL_COMPARE_END,
-    FUNCTION,
-    FUN_PREAMBLE,
-    FUN_EPILOG
+    LABEL_BLOCK,
+    FUNCTION
 } Label_type;
 
 typedef struct {
@@ -58,6 +104,7 @@ typedef struct {
     Label_type label;
     int label_sn;
     const char * label_name;
+    int label_id;       // label defined or branched to, -1 if none
 } Instruction_line;
 
 typedef enum {
@@ -97,19 +144,77 @@ typedef enum {
 
 void stack_push(int reg);
 void stack_pop(int reg);
+
+/*
+ * entry and exit of a function: frame_size bytes are allocated below $sp,
+ * slots addressed from 4($sp) up as usual, with $ra saved in the word
+ * above them when save_ra is set; a function with neither gets no frame
+ * returns: bytes the prologue moves $sp down by
+ */
+int add_prologue(int frame_size, int save_ra);
+void add_epilogue(int frame_size, int save_ra);
 void codetable_init();
 void codetable_destroy();
 int get_next_label_sn(Label_type label);
 int get_last_label_sn(Label_type label);
+
+/*
+ * every label, numbered or named, has one integer id; ids are dense from 0
+ * returns: id of a numbered label, -1 if it was never handed out
+ */
+int get_label_id(Label_type label, int label_sn);
+int get_label_count();
 Instruction_line * create_instruction(Instruction_type type, int dest_reg, int reg1, int reg2);
 Instruction_line * create_jump_instruction(Instruction_type type, int dest_reg, int reg1, Label_type label, int label_sn);
 Instruction_line * create_instruction_label(Label_type label, int label_sn);
 Instruction_line * create_instruction_offset(Instruction_type type, int dest_reg, int reg1, int reg2, int offset);
 Instruction_line * create_instruction_named_label(Label_type label, const char * name);
 Instruction_line * create_jump_label_instruction(Instruction_type type, int dest_reg, int reg1, const char * name);
+
+/*
+ * a load or store of reg at label + offset, for small data: the assembler
+ * makes it one instruction relative to $gp
+ */
+Instruction_line * create_instruction_data(Instruction_type type, int reg, const char * label, int offset);
 void stack_push(int reg);
 void add_instruction(Instruction_line * line);
 int codetable_print(FILE * out);
-Instruction_line * create_instruction_text(Label_type label);
+void print_instruction(FILE * out, Instruction_line * l);
+int get_instruction_count();
+Instruction_line * get_instruction(int index);
+
+/*
+ * chooses how read statements get their input: per value with a syscall,
+ * or from the buffered input runtime when on is set
+ */
+void codetable_set_buffered_input(int on);
+
+/*
+ * adds the instructions of a read of a char or an int, with the value left
+ * in $v0; the output written so far is printed first
+ */
+void add_read(int is_char);
+/*
+ * reserves size bytes of static data, word aligned; data of at most
+ * SMALL_DATA_SIZE bytes is declared .extern so it lands in the area
+ * addressed from $gp, the rest goes in the .data section
+ * returns: the label of the data, owned by the codetable
+ */
+const char * codetable_add_data(const char * name, int size);
+
+/*
+ * returns: 1 if the data of label, from codetable_add_data(), is small
+ */
+int codetable_is_small_data(const char * label);
+
+/*
+ * returns: 1 if value fits the immediate field of an instruction
+ */
+int is_immediate(long long value);
+
+/*
+ * returns: 1 if name is one of the runtime routines
+ */
+int is_runtime_routine(const char * name);
 
 #endif
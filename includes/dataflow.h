@@ -0,0 +1,57 @@
+#ifndef _DATAFLOW_H
+#define _DATAFLOW_H
+
+// iterative bit-vector dataflow over the blocks of one CFG function
+//
+// the client sizes the problem, fills gen and kill of every block and
+// calls dataflow_solve().  a block's output is gen | (input & ~kill); its
+// input is the meet of the outputs of its predecessors (forward) or
+// successors (backward).  blocks without predecessors (forward) or
+// successors (backward) meet the boundary set instead.
+//
+// pending blocks are kept in a worklist ordered by reverse post-order of
+// the CFG (post-order for backward problems) and swept cyclically: the
+// next block taken is the first pending one after the last block taken,
+// wrapping around to the start of the order when none is left after it,
+// so most problems converge in two or three sweeps.
+//
+// in and out are in program order for both directions: for a backward
+// problem out is the value at the end of the block and in at its start.
+
+#include "bitset.h"
+#include "cfg.h"
+
+typedef enum {
+    DATAFLOW_FORWARD,
+    DATAFLOW_BACKWARD
+} Dataflow_direction;
+
+typedef enum {
+    DATAFLOW_UNION,         // may problems, e.g. liveness
+    DATAFLOW_INTERSECTION   // must problems, e.g. available expressions
+} Dataflow_meet;
+
+typedef struct {
+    Dataflow_direction direction;
+    Dataflow_meet meet;
+    int bits;
+    int words;
+    int first_block;    // CFG index of local block 0
+    int block_count;
+    Bitset * gen;       // indexed by local block, i.e. CFG index - first_block
+    Bitset * kill;
+    Bitset * in;
+    Bitset * out;
+    Bitset boundary;    // clear unless the client sets it
+    int * order;        // local blocks in worklist order
+    int visits;         // blocks evaluated by the last solve
+} Dataflow;
+
+/*
+ * returns: a problem over the blocks of a CFG function, gen and kill clear
+ */
+Dataflow * dataflow_new(int function, Dataflow_direction direction, Dataflow_meet meet, int bits);
+void dataflow_free(Dataflow * flow);
+void dataflow_solve(Dataflow * flow);
+
+#endif
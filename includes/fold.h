@@ -0,0 +1,22 @@
+#ifndef _FOLD_H
+#define _FOLD_H
+
+// constant folding and algebraic simplification of the annotated AST
+//
+// runs between semantic analysis and code generation, so both code
+// generators and the call graph see the simplified tree.  constant
+// subtrees become NUM nodes, constants in chains of + - and * are
+// combined (a+1+2 is a+3), identities such as x*1, x+0, x-x and x*0 are
+// applied when the operand that goes away has no side effects, and an if
+// or while whose condition is constant keeps only the arm that can run.
+// arithmetic wraps around in 32 bits like the generated code.
+
+#include "ast.h"
+
+/*
+ * simplifies the bodies of every function; semantic_analysis() must have
+ * succeeded
+ */
+void fold_constants();
+
+#endif
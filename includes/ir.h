@@ -0,0 +1,132 @@
+#ifndef _IR_H
+#define _IR_H
+
+// three-address intermediate representation
+//
+// a program is a list of IR functions, one per semantic function.  a
+// function is a list of basic blocks; every block ends in exactly one
+// terminator (IR_JUMP, IR_BRANCH or IR_RET).  values live in an unbounded
+// set of virtual registers numbered from 0.  variables are not values:
+// they are read and written with explicit IR_LOAD / IR_STORE to the frame
+// slot or global of their Symbol.
+//
+// memory operands: an IR_LOAD, IR_STORE or IR_ADDR with sym >= 0 addresses
+// the storage of that Symbol plus imm; with sym < 0 it addresses the value
+// of virtual register b plus imm.
+
+#include <stdio.h>
+#include "semantic.h"
+
+typedef enum {
+    IR_NOP,
+    IR_LI,      // dst = imm
+    IR_MOVE,    // dst = a
+    IR_ADD,     // dst = a + b
+    IR_SUB,     // dst = a - b
+    IR_ADDU,    // dst = a + b, wrapping around instead of trapping on overflow
+    IR_SUBU,    // dst = a - b, wrapping around instead of trapping on overflow
+    IR_MUL,     // dst = a * b
+    IR_DIV,     // dst = a / b
+    IR_SLL,     // dst = a << imm
+    IR_SRA,     // dst = a >> imm, arithmetic
+    IR_SRL,     // dst = a >> imm, logical
+    IR_ADDI,    // dst = a + imm, imm a 16-bit immediate
+    IR_SLTI,    // dst = a < imm, imm a 16-bit immediate
+    IR_XORI,    // dst = a ^ imm, imm an unsigned 16-bit immediate
+    IR_MULHI,   // dst = high word of the signed product a * b
+    IR_SLT,     // dst = a < b
+    IR_SLE,     // dst = a <= b
+    IR_SGT,     // dst = a > b
+    IR_SGE,     // dst = a >= b
+    IR_SEQ,     // dst = a == b
+    IR_SNE,     // dst = a != b
+    IR_NEG,     // dst = -a
+    IR_NOT,     // dst = !a
+    IR_ADDR,    // dst = address of the memory operand
+    IR_LOAD,    // dst = memory operand, type gives the width
+    IR_STORE,   // memory operand = a, type gives the width
+    IR_PARAM,   // dst = incoming register argument number imm
+    IR_CALL,    // dst = call of function sym with args
+    IR_READ,    // dst = value read from input, type picks int or char
+    IR_WRITE,   // print a
+    IR_WRITELN, // print a newline
+    IR_JUMP,    // goto target[0]
+    IR_BRANCH,  // if a != 0, or a compare b, goto target[0] else goto target[1]
+    IR_RET      // return a, or nothing if a < 0
+} Ir_op;
+
+typedef struct {
+    Ir_op op;
+    VARTYPE type;       // T_INT or T_CHAR
+    int dst;            // virtual registers, -1 if unused
+    int a;
+    int b;
+    int imm;
+    int sym;            // Symbol of a memory operand, function of a call
+    int * args;         // virtual registers of call arguments
+    int arg_count;
+    int target[2];      // successor blocks of a terminator
+    Ir_op compare;      // comparison of an IR_BRANCH, IR_SLT to IR_SNE, or
+                        // IR_NOP when it tests a != 0
+} Ir_inst;
+
+typedef struct {
+    Ir_inst * insts;
+    int count;
+    int max;
+    int loop_depth;     // number of while loops around the block
+} Ir_block;
+
+typedef struct {
+    int fun;            // index in the semantic function table
+    Ir_block * blocks;  // blocks[0] is the entry
+    int block_count;
+    int block_max;
+    int vreg_count;
+} Ir_function;
+
+// building
+void ir_init();
+void ir_destroy();
+Ir_function * ir_add_function(int fun);
+int ir_new_block(Ir_function * f, int loop_depth);
+int ir_new_vreg(Ir_function * f);
+Ir_inst * ir_append(Ir_function * f, int block, Ir_op op);
+int ir_is_terminator(Ir_op op);
+int ir_block_terminated(Ir_function * f, int block);
+
+/*
+ * returns: number of successors of a block (0 to 2), stored in succ
+ */
+int ir_successors(Ir_function * f, int block, int succ[2]);
+
+/*
+ * removes blocks that cannot be reached from the entry and renumbers
+ * the rest, keeping their order
+ */
+void ir_remove_unreachable(Ir_function * f);
+
+/*
+ * returns: the comparison, IR_SLT to IR_SNE, that holds exactly when op
+ *          does not
+ */
+Ir_op ir_negated(Ir_op op);
+
+/*
+ * returns: the comparison that holds for b and a exactly when op holds
+ *          for a and b
+ */
+Ir_op ir_swapped(Ir_op op);
+
+int get_ir_function_count();
+Ir_function * get_ir_function(int index);
+
+void ir_dump(FILE * out);
+
+// AST to IR lowering, in irgen.c; semantic_analysis() must have succeeded
+void ir_lower(ast_node * root);
+
+// IR to codetable instruction selection, in isel.c; fills the codetable
+void ir_codegen();
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _LIVENESS_H
+#define _LIVENESS_H
+
+// liveness of physical registers and frame slots over the codetable CFG
+//
+// the sets of a function have one bit per general purpose register (the
+// register number) followed by one bit per word of its stack frame.  a
+// slot is named by its word address relative to $sp at function entry;
+// $sp is followed through every addi to it, so the pushes of the direct
+// AST emitter and of call sequences are understood.  when $sp does not
+// agree on every path into a block, the function's slots are not tracked
+// and only registers are.  words only reached through computed addresses
+// (array elements) are not slots.
+//
+// stores through any other base kill nothing; loads through another base
+// read every slot if the function ever computes an address from $sp, and
+// calls read every slot.  at a jal the arguments and $sp are used and the
+// caller-saved registers are clobbered.
+
+#include <stdio.h>
+#include "bitset.h"
+#include "cfg.h"
+
+#define LIVENESS_SLOT_BIT 32    // bit of slot 0; registers are bits 0 .. 31
+
+/*
+ * solves liveness for every function of the CFG; cfg_build() must have run
+ */
+void liveness_build();
+void liveness_destroy();
+
+/*
+ * returns: number of words in the sets of the function
+ */
+int get_liveness_words(int function);
+int get_slot_count(int function);
+
+/*
+ * returns: entry-relative byte address of slot 0 of the function
+ */
+int get_slot_base(int function);
+
+Bitset get_live_in(int block);
+Bitset get_live_out(int block);
+
+/*
+ * stores the set live right after an instruction into live, which must
+ * have get_liveness_words() words; walks back from the end of its block
+ */
+void get_live_after(int instruction, Bitset live);
+
+/*
+ * prints live-in and live-out of every block, then a summary with the
+ * time the analysis took
+ */
+void liveness_dump(FILE * out);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _REGALLOC_H
+#define _REGALLOC_H
+
+// linear-scan register allocation of IR virtual registers
+//
+// instructions are numbered in block order and every virtual register
+// gets the interval from its first to its last appearance, stretched to
+// the end of any loop it is live into.  intervals are walked by start;
+// each takes a free register or, when none is left, the interval ending
+// furthest away is spilled to a frame slot.
+//
+// registers: $t0-$t9 and $v1 always, $a0-$a3 for intervals that neither
+// hold an incoming argument's register, nor meet a call, nor cross a read
+// or write (the output runtime changes $a0); an interval that ends as
+// argument k of the only call it meets may take $a<k>.  an incoming
+// argument prefers its own register and an argument the register it is
+// passed in, when free, so neither needs a move.  values live across a
+// call are saved by the caller, which can tell them from the intervals.
+// a function that spills keeps $t8 and $t9 as scratch registers for
+// reloading spilled operands; one that stores to large globals keeps $t9
+// to form the address.
+
+#include "ir.h"
+
+typedef struct {
+    int * reg;              // register of each virtual register, -1 if spilled
+    int * spill_slot;       // spill slot of each spilled virtual register, else -1
+    int * start;            // interval of each virtual register, as positions in
+    int * end;              // block order; end is -1 if it is never used
+    int spill_slot_count;   // slots needed, spilled intervals share them when disjoint
+    int spill_count;        // virtual registers spilled
+    unsigned int used;      // mask of the registers assigned
+    int scratch[2];         // reload registers, -1 if not reserved
+} Allocation;
+
+void regalloc_function(Ir_function * f, Allocation * result);
+void regalloc_free(Allocation * result);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _SEMANTIC_H
+#define _SEMANTIC_H
+
+// semantic analysis: resolves every name in the AST once, right after
+// parsing, and annotates the tree so later phases never look names up.
+//
+// after semantic_analysis():
+//   - every ID node that names a variable, array or function has
+//     symbol->sym set to the index of its Symbol
+//   - every expression node has symbol->type set to its VARTYPE
+//   - FUN_DECL nodes have symbol->sym set to the function's Symbol
+// nodes that are not resolved keep sym == -1 and type == -1.
+
+#include "parser.h"
+#include "symtab.h"
+
+typedef enum {
+    T_INT,
+    T_CHAR,
+    T_INTARR,
+    T_CHARARR
+} VARTYPE;
+
+typedef enum {
+    STORAGE_GLOBAL,
+    STORAGE_LOCAL,
+    STORAGE_PARAM,
+    STORAGE_FUNCTION
+} STORAGE;
+
+typedef struct {
+    const char * name;
+    SYMKIND kind;       // SYM_VARIABLE, SYM_ARRAY or SYM_FUNCTION
+    VARTYPE type;       // scalar or element type; return type of a function
+    STORAGE storage;
+    int count;          // number of elements of an array (0 for array parameters)
+    int function;       // index of the owning function, or of the function itself
+    int slot;           // frame slot within the owning function, or global index
+    int param_index;    // position in the parameter list, -1 if not a parameter
+    int scope;          // block declaring a local, blocks numbered in preorder; -1 if not a local
+    int scope_end;      // last block nested in it, so [scope, scope_end] is its lifetime
+    int line_no;
+} Symbol;
+
+typedef struct {
+    const char * name;
+    VARTYPE type;
+    int symbol;         // the function's own Symbol
+    int * params;       // Symbol of each parameter, in order
+    int param_count;
+    int param_max;
+    int slot_count;     // frame slots used by parameters and locals
+    ast_node * node;    // the FUN_DECL node
+} FunDef;
+
+/*
+ * resolves names and computes types for the whole program
+ *   root: the ROOT node of the AST
+ *   returns: the number of semantic errors found (all of them are reported)
+ */
+int semantic_analysis(ast_node * root);
+void semantic_destroy();
+
+Symbol * get_symbol(int index);
+int get_symbol_count();
+FunDef * get_function(int index);
+int get_function_count();
+int get_global_count();
+
+// true if an ID node is a call (its only child is an EXPR_LIST)
+int is_call_node(ast_node * node);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+// named per-function counters reported by --stats
+//
+// passes add to a counter of a function; the dump prints one line per
+// function, counters in the order they were first added, then the totals.
+
+#include <stdio.h>
+
+void stats_add(const char * function, const char * counter, int value);
+int stats_get(const char * function, const char * counter);
+void stats_dump(FILE * out);
+void stats_destroy();
+
+#endif
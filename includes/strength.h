@@ -0,0 +1,50 @@
+#ifndef _STRENGTH_H
+#define _STRENGTH_H
+
+// strength reduction of multiplication and division by a constant
+//
+// a plan is a list of steps on an accumulator that starts as the operand
+// x; both code generators emit one instruction or two per step.  adds and
+// subtracts are emitted as addu and subu, which wrap around like mul and
+// div, since a step can overflow where the result does not: x * 3 is
+// (x << 2) - x.  the cost model counts one cycle for li, shifts, adds and
+// mfhi and the R3000 latencies for the multiply and divide unit: a
+// product by a constant is planned only when the steps are cheaper than
+// li + mul, a quotient is always cheaper than li + div.
+
+#define MULTIPLY_COST 12
+#define DIVIDE_COST 35
+#define MAX_STEPS 64
+
+typedef enum {
+    STEP_SLL,       // acc = acc << imm
+    STEP_SRA,       // acc = acc >> imm, arithmetic
+    STEP_SRL,       // acc = acc >> imm, logical
+    STEP_ADD_X,     // acc = acc + x
+    STEP_SUB_X,     // acc = acc - x
+    STEP_NEG,       // acc = -acc
+    STEP_MULHI,     // acc = high word of the signed product acc * imm
+    STEP_ADD_SIGN   // acc = acc + 1 if acc is negative (srl by 31 and add)
+} Step_op;
+
+typedef struct {
+    Step_op op;
+    int imm;
+} Step;
+
+/*
+ * plans x * c as shifts and adds
+ * returns: number of steps (0 when the product is x), -1 if li + mul is
+ *          cheaper
+ */
+int plan_multiply(int c, Step * steps);
+
+/*
+ * plans the signed quotient x / d, rounded towards zero like div: a power
+ * of two is a shift with a bias for negative x, any other divisor a
+ * multiplication by its magic number
+ * returns: number of steps (0 when the quotient is x), -1 if d is 0
+ */
+int plan_divide(int d, Step * steps);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _SYMTAB_H
+#define _SYMTAB_H
+
+// scoped symbol table: a single open-addressing hash map from (kind, name)
+// to the innermost visible binding, plus an undo log that restores the
+// shadowed bindings when a scope is popped.  insert, lookup and popping a
+// scope are all O(1) per binding.
+//
+// variables, arrays and functions live in separate namespaces, so a local
+// array never hides a scalar of the same name (and vice versa).
+// the table does not own the names; they must outlive their bindings.
+
+typedef enum {
+    SYM_VARIABLE,
+    SYM_ARRAY,
+    SYM_FUNCTION
+} SYMKIND;
+
+void symtab_init();
+void symtab_destroy();
+
+void symtab_push_scope();
+void symtab_pop_scope();
+int symtab_scope_depth();
+
+/*
+ * binds name to value in the innermost scope
+ * returns: 0 on success, -1 if name is already bound in the innermost scope
+ *          (the earlier binding is kept)
+ */
+int symtab_insert(SYMKIND kind, const char * name, int value);
+
+/*
+ * binds name to value in the outermost scope; global bindings are never
+ * undone by symtab_pop_scope and must not be shadowed
+ * returns: 0 on success, -1 if name is already bound
+ */
+int symtab_insert_global(SYMKIND kind, const char * name, int value);
+
+/*
+ * returns: the value of the innermost binding of name, or -1 if unbound
+ */
+int symtab_lookup(SYMKIND kind, const char * name);
+
+/*
+ * returns: the scope depth of the innermost binding of name, or -1 if unbound
+ */
+int symtab_lookup_depth(SYMKIND kind, const char * name);
+
+#endif
@@ -242,9 +242,9 @@ static int start(FILE * fd) {
   case '!':
     return neg(fd);
   case '<':
-    return greater(fd);
-  case '>':
     return smaller(fd);
+  case '>':
+    return greater(fd);
   case '&':
     return and(fd);
   case '|':
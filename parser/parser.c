@@ -900,25 +900,26 @@ static ast_node * block(FILE * fd)
 	return this_node;
 }
 
-static void param_decl_(FILE * fd)
+static ast_node * param_decl_(FILE * fd)
 {
 	print_nonterminal("ParamDecl'");
 	switch (lookahead.type)
 	{
 	case LBRACKET:
 	{
-		comp(fd, LBRACKET, 0);
+		token t = comp(fd, LBRACKET, 0);
 		comp(fd, RBRACKET, 1);
-		return;
+		return new_ast_node(new_ast_terminal_info(t)); // marks an array parameter
 	}
 	case COMMA:
 	case RPAREN:
 	{
-		return;
+		return NULL;
 	}
 	default:
 		expansion_error();
 	}
+	return NULL;
 }
 
 static ast_node * param_decl(FILE * fd)
@@ -927,11 +928,12 @@ static ast_node * param_decl(FILE * fd)
 	ast_node * type_node = type(fd); // Type node
 	token t = comp(fd, ID, 0);
 	ast_node * id_node = new_ast_node(new_ast_terminal_info(t)); // create an id node
-	param_decl_(fd);
+	ast_node * array_node = param_decl_(fd); // ParamDecl' node
 
 	ast_node * this_node = new_ast_node(new_ast_nonterminal_info(PARAM_DECL)); // create a ParamDecl node
 	add_child_node(this_node, type_node);
 	add_child_node(this_node, id_node);
+	if (array_node != NULL) add_child_node(this_node, array_node);
 	return this_node;
 }
 
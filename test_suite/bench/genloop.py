@@ -0,0 +1,26 @@
+# writes a C-- main() with one loop around n statements of straight-line
+# code, ifs and nested whiles, a large CFG for timing the dataflow solver:
+#     python3 genloop.py 4000 > big.c--
+#     ./mycc --dump-liveness big.c-- big.mips | tail -1
+
+import sys
+
+n = int(sys.argv[1])
+print("int main() {")
+print("  int i; int a; int b; int c; int d[10];")
+print("  i = 0; a = 1; b = 2; c = 3;")
+print("  while (i < 10) {")
+for k in range(n):
+    v = "abc"[k % 3]
+    w = "abc"[(k + 1) % 3]
+    if k % 5 == 0:
+        print(f"    if ({v} < {k}) {{ {w} = {w} + {v} * 3; d[{k % 10}] = {w}; }} else {{ {v} = {v} - 1; }}")
+    elif k % 7 == 0:
+        print(f"    while ({v} > {k}) {{ {v} = {v} - {w}; }}")
+    else:
+        print(f"    {v} = {w} + d[{k % 10}] - {k % 13};")
+print("    i = i + 1;")
+print("  }")
+print("  write a; writeln;")
+print("  return 0;")
+print("}")
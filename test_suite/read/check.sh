@@ -0,0 +1,30 @@
+#!/bin/sh
+# compiles readstress.c-- at -O0 and -O1, with and without
+# --buffered-input, and checks that both input runtimes give the same
+# output on every *.in file here
+# usage: ./check.sh [mycc [simulator]], by default ../../codegen/mycc and
+#        "spim -quiet -file"
+
+cd "$(dirname "$0")"
+mycc=${1:-../../codegen/mycc}
+sim=${2:-spim -quiet -file}
+tmp=${TMPDIR:-/tmp}/readstress.$$
+status=0
+
+for level in -O0 -O1; do
+    "$mycc" $level readstress.c-- $tmp.plain.mips > /dev/null || exit 1
+    "$mycc" $level --buffered-input readstress.c-- $tmp.buffered.mips > /dev/null || exit 1
+    for input in *.in; do
+        $sim $tmp.plain.mips < $input > $tmp.plain.out 2>&1
+        $sim $tmp.buffered.mips < $input > $tmp.buffered.out 2>&1
+        if cmp -s $tmp.plain.out $tmp.buffered.out; then
+            echo "ok    $level $input"
+        else
+            echo "FAIL  $level $input"
+            diff $tmp.plain.out $tmp.buffered.out
+            status=1
+        fi
+    done
+done
+rm -f $tmp.*
+exit $status